@@ -11,38 +11,43 @@
 
 #include <thrill/api/cache.hpp>
 #include <thrill/api/generate.hpp>
+#include <thrill/api/read_binary_rows.hpp>
 #include <thrill/api/read_lines.hpp>
 #include <thrill/api/write_lines.hpp>
 #include <thrill/common/logger.hpp>
 #include <thrill/common/stats_timer.hpp>
 #include <thrill/common/string.hpp>
 #include <tlx/cmdline_parser.hpp>
+#include <tlx/string/split_view.hpp>
 #include <thrill/api/inter_map_2d.hpp>
+#include <thrill/api/iterate_inter_map.hpp>
 #include <thrill/api/rebalance.hpp>
 #include <thrill/api/sample.hpp>
+#include <thrill/api/sum.hpp>
+#include <thrill/api/window.hpp>
 #include <thrill/api/all_gather.hpp>
 #include <thrill/common/ndarray.hpp>
+#include <thrill/common/span.hpp>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <random>
 #include <string>
 #include <utility>
 #include <vector>
 #include <mpi.h>
 #include <ctime>
+#include <fstream>
+#include <memory>
 
-#define BI 0
-#define AI 1
-#define CI 2
-#define PBI 3
-#define PAI 4
-#define PCI 5
-#define UBI 6
-#define UAI 7
-#define UCI 8
-#define PI 9
-#define UI 10
-#define B 11
-#define X 12
+#include "gabp/block_gabp.hpp"
+#include "gabp/checkpoint.hpp"
+#include "gabp/refinement.hpp"
+#include "gabp/row_layout.hpp"
+#include "gabp/soa_engine.hpp"
+#include "gabp/sparse_gabp.hpp"
+#include "gabp/spike_solver.hpp"
 
 
 using namespace thrill;               // NOLINT
@@ -51,333 +56,700 @@ using namespace thrill;               // NOLINT
 /******************************************************************************/
 // Run methods
 
-static void RunGaBP(
-    api::Context& ctx, size_t y_size, std::vector<std::string>& input_filelist, const std::string& output) {
-    ctx.enable_consume();
+//! One GaBP sweep over rows rows. The first and the last row are the halo
+//! rows of the neighbouring workers (or the all-zero sentinel rows at both
+//! ends of the matrix) and are only read, through halo(i), which points to the
+//! values of row i. The messages of the inner rows are updated in place
+//! through row(i), returns the summed change of x over the inner rows.
+template <typename RowFunction, typename HaloFunction>
+static double GaBPSweepRows(size_t rows, const RowFunction& row, const HaloFunction& halo) {
 
-    common::StatsTimerStart timer;
+    if(rows < 2) return 0;
 
-    auto lines = ReadLines(ctx, input_filelist);
+    size_t i;
 
-    auto numbers = lines.template FlatMap<double>(
-        [lines](const std::string& line, auto emit) -> void{
-            tlx::split_view(' ', line, [&](const tlx::string_view& sv){
-                if(sv.size() == 0) return;
-                emit((double)atof(sv.to_string().c_str()));
-            });
-        });
- 
-
-// bi,ai,ci,Pbi,Pai,Pci,Ubi,Uai,Uci,Pi,Ui,b,x
-
-    auto nums = numbers.InterMap2D([y_size](std::vector<double> values){
- 
-        std::vector<double> results;
+    std::vector<double> tmp_ui_before(rows);
+    std::vector<double> tmp_ui_after(rows);
+    std::vector<double> tmp_pi_before(rows);
+    std::vector<double> tmp_pi_after(rows);
 
-        int i,j;
+    for(i=1;i<rows-1;i++){
+        tmp_ui_before[i] = row(i)[B];
+        tmp_pi_before[i] = row(i)[AI];
 
-        double tmp_ui_before[values.size()/y_size];
-        double tmp_ui_after[values.size()/y_size];
-        double tmp_pi_before[values.size()/y_size];
-        double tmp_pi_after[values.size()/y_size];
+        if(row(i)[CI] != 0){
+            tmp_ui_before[i] = tmp_ui_before[i] + halo(i+1)[PBI] * halo(i+1)[UBI];
+            tmp_pi_before[i] = tmp_pi_before[i] + halo(i+1)[PBI];
+        }
 
-        for(i=1;i<values.size()/y_size-1;i++){
-            tmp_ui_before[i] = values[i*y_size+B];
-            tmp_pi_before[i] = values[i*y_size+AI];
+        if(row(i)[BI] != 0){
+            tmp_ui_before[i] = tmp_ui_before[i] + halo(i-1)[PCI] * halo(i-1)[UCI];
+            tmp_pi_before[i] = tmp_pi_before[i] + halo(i-1)[PCI];
+        }
+    }
 
-            if(values[i*y_size+CI] != 0){
-                tmp_ui_before[i] = tmp_ui_before[i] + values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI];
-                tmp_pi_before[i] = tmp_pi_before[i] + values[(i+1)*y_size+PBI];
-            }
+    for(i=1;i<rows-1;i++){
+        row(i)[PI] = row(i)[AI];
+        row(i)[PAI] = row(i)[AI];
+        row(i)[UI] = row(i)[B];
+        row(i)[UAI] = row(i)[B]/row(i)[AI];
 
-            if(values[i*y_size] != 0){
-                tmp_ui_before[i] = tmp_ui_before[i] + values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI];
-                tmp_pi_before[i] = tmp_pi_before[i] + values[(i-1)*y_size+PCI];
-            }
+        if(row(i)[BI] != 0){
+            row(i)[PI] = row(i)[PI] + halo(i-1)[PCI];
+            row(i)[UI] = row(i)[UI] + halo(i-1)[UCI] * halo(i-1)[PCI];
         }
 
+        if(row(i)[CI] != 0){
+            row(i)[PI] = row(i)[PI] + halo(i+1)[PBI];
+            row(i)[UI] = row(i)[UI] + halo(i+1)[UBI] * halo(i+1)[PBI];
+        }
 
-        if(values[BI] == 0 && values[AI] == 0 & values[CI] == 0){
-            for(j=0;j<y_size;j++){
-                results.push_back(values[j]);
-            }
+        if(row(i)[PI] == 0) row(i)[PI] = 0.00001;
+        row(i)[UI] = row(i)[UI] / row(i)[PI];
+    }
 
+    double tmp;
+    for(i=1;i<rows-1;i++){
+        if(row(i)[BI] != 0){
+            tmp = (row(i)[PI] - halo(i-1)[PCI]);
+            if(tmp == 0)tmp = 0.00001;
+            row(i)[PBI] = -1 * row(i)[BI] * row(i)[BI] / tmp;
+            row(i)[UBI] = (row(i)[PI] * row(i)[UI] - halo(i-1)[PCI] * halo(i-1)[UCI]) / row(i)[BI];
         }
 
-        for(i=1;i<values.size()/y_size-1;i++){
-            values[i*y_size+PI] = values[i*y_size+AI];
-            values[i*y_size+PAI] = values[i*y_size+AI];
-            values[i*y_size+UI] = values[i*y_size+B];
-            values[i*y_size+UAI] = values[i*y_size+B]/values[i*y_size+AI];           
+        if(row(i)[CI] !=0){
+            tmp = (row(i)[PI] - halo(i+1)[PBI]);
+            if(tmp == 0) tmp = 0.00001;
+            row(i)[PCI] = -1 * row(i)[CI] * row(i)[CI] / tmp;
+            row(i)[UCI] = (row(i)[PI] * row(i)[UI] - halo(i+1)[PBI] * halo(i+1)[UBI]) / row(i)[CI];
+        }
+    }
 
-            if(values[i*y_size+BI] != 0){
-                values[i*y_size+PI] = values[i*y_size+PI] + values[(i-1)*y_size+PCI];
-                values[i*y_size+UI] = values[i*y_size+UI] + values[(i-1)*y_size+UCI] * values[(i-1)*y_size+PCI];
-            }
+    double err = 0;
+    for(i=1;i<rows-1;i++){
+        tmp_ui_after[i] = row(i)[B];
+        tmp_pi_after[i] = row(i)[AI];
 
-            if(values[i*y_size+CI] != 0){
-                values[i*y_size+PI] = values[i*y_size+PI] + values[(i+1)*y_size+PBI];
-                values[i*y_size+UI] = values[i*y_size+UI] + values[(i+1)*y_size+UBI] * values[(i+1)*y_size+PBI];
-            }
+        if(row(i)[CI] != 0){
+            tmp_ui_after[i] = tmp_ui_after[i] + halo(i+1)[PBI] * halo(i+1)[UBI];
+            tmp_pi_after[i] = tmp_pi_after[i] + halo(i+1)[PBI];
+        }
 
-            if(values[i*y_size+PI] == 0) values[i*y_size+PI] = 0.00001;
-            values[i*y_size+UI] = values[i*y_size+UI] / values[i*y_size+PI];
+        if(row(i)[BI] != 0){
+            tmp_ui_after[i] = tmp_ui_after[i] + halo(i-1)[PCI] * halo(i-1)[UCI];
+            tmp_pi_after[i] = tmp_pi_after[i] + halo(i-1)[PCI];
         }
 
-        double tmp;
-        double err = 0;
-        for(i=1;i<values.size()/y_size-1;i++){
-            if(values[i*y_size+BI] != 0){
+        double x_before = tmp_ui_before[i] / tmp_pi_before[i];
+        double x_after = tmp_ui_after[i] / tmp_pi_after[i];
+        if(x_after > x_before){
+            err += x_after - x_before;
+        }else{
+            err += x_before - x_after;
+        }
+    }
 
-                tmp = (values[i*y_size+PI] - values[(i-1)*y_size+PCI]);
-                if(tmp == 0)tmp = 0.00001;
-                values[i*y_size+PBI] = -1 * values[i*y_size+BI] * values[i*y_size+BI] / tmp;
-                values[i*y_size+UBI] = (values[i*y_size+PI] * values[i*y_size+UI] - values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI]) / values[i*y_size+BI];
-            }
+    return err;
+}
 
-            if(values[i*y_size+CI] !=0){
-                tmp = (values[i*y_size+PI] - values[(i+1)*y_size+PBI]);
-                if(tmp == 0) tmp = 0.00001;
-                values[i*y_size+PCI] = -1 * values[i*y_size+CI] * values[i*y_size+CI] / tmp;
+//! GaBPSweep on the rows of a buffer with the halo rows.
+static double GaBPSweep(std::vector<double>& values, size_t y_size) {
+    auto row = [&values, y_size](size_t i) { return &values[i*y_size]; };
+    return GaBPSweepRows(values.size() / y_size, row, row);
+}
 
-                values[i*y_size+UCI] = (values[i*y_size+PI] * values[i*y_size+UI] - values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI]) / values[i*y_size+CI];
+//! Red-black half sweep: updates the messages of the inner rows of one
+//! colour only, the rows whose global index has the given parity. The inner
+//! row i has the global index first + i - 1. As the neighbours of these rows
+//! are of the other colour, all of them read the latest messages and the
+//! update can be done in place. x of the updated rows is kept in the X column,
+//! returns its summed change.
+static double GaBPColorSweep(std::vector<double>& values, size_t y_size, size_t first, size_t parity) {
+
+    size_t rows = values.size() / y_size;
+    if(rows < 2) return 0;
+
+    double err = 0;
+    for(size_t i = (first % 2 == parity) ? 1 : 2; i < rows-1; i += 2){
+        double* row = &values[i*y_size];
+        const double* up = row - y_size;
+        const double* down = row + y_size;
+
+        double p = row[AI], u = row[B];
+        if(row[BI] != 0){
+            p = p + up[PCI];
+            u = u + up[PCI] * up[UCI];
+        }
+        if(row[CI] != 0){
+            p = p + down[PBI];
+            u = u + down[PBI] * down[UBI];
+        }
+        if(p == 0) p = 0.00001;
+        row[PI] = p;
+        row[UI] = u / p;
 
-            }
+        err += std::abs(row[UI] - row[X]);
+        row[X] = row[UI];
 
+        double tmp;
+        if(row[BI] != 0){
+            tmp = p - up[PCI];
+            if(tmp == 0) tmp = 0.00001;
+            row[PBI] = -1 * row[BI] * row[BI] / tmp;
+            row[UBI] = (p * row[UI] - up[PCI] * up[UCI]) / row[BI];
         }
+        if(row[CI] != 0){
+            tmp = p - down[PBI];
+            if(tmp == 0) tmp = 0.00001;
+            row[PCI] = -1 * row[CI] * row[CI] / tmp;
+            row[UCI] = (p * row[UI] - down[PBI] * down[UBI]) / row[CI];
+        }
+    }
+    return err;
+}
 
-        for(i=1; i<values.size()/y_size-1;i++){
-            tmp_ui_after[i] = values[i*y_size+B];
-            tmp_pi_after[i] = values[i*y_size+AI];
+//! Computes x of the inner rows from the messages of the neighbouring rows.
+static api::DIA<double> GaBPSolution(const api::DIA<double>& rows, size_t y_size) {
+    return rows.InterMap2D([y_size](std::vector<double> values) {
+        std::vector<double> results;
+        int i;
+
+        for(i=1;i<values.size()/y_size-1;i++){
+            values[i*y_size+PI] = values[i*y_size+AI];
+            values[i*y_size+UI] = values[i*y_size+B];
 
             if(values[i*y_size+CI] != 0){
-                tmp_ui_after[i] = tmp_ui_after[i] + values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI];
-                tmp_pi_after[i] = tmp_pi_after[i] + values[(i+1)*y_size+PBI];
+                values[i*y_size+PI] = values[i*y_size+PI] + values[(i+1)*y_size+PBI];
+                values[i*y_size+UI] = values[i*y_size+UI] + values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI];
             }
 
             if(values[i*y_size] != 0){
-                tmp_ui_after[i] = tmp_ui_after[i] + values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI];
-                tmp_pi_after[i] = tmp_pi_after[i] + values[(i-1)*y_size+PCI];
-            }
-
-            double x_before = tmp_ui_before[i] / tmp_pi_before[i];
-            double x_after = tmp_ui_after[i] / tmp_pi_after[i];
-            if(x_after > x_before){
-                err += x_after - x_before;
-            }else{
-                err += x_before - x_after;
+                values[i*y_size+PI] = values[i*y_size+PI] + values[(i-1)*y_size+PCI];
+                values[i*y_size+UI] = values[i*y_size+UI] + values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI];
             }
+            values[i*y_size+X] = values[i*y_size+UI] / values[i*y_size+PI];
+            results.push_back(values[i*y_size+X]);
+        }
+ 
+        //for(i=1;i<values.size()/y_size-1;i++){
+        //   std::cout << "x[" << i << "]=" << values[i*y_size+X] << " ";
+        //}  
+        return results;
+        },y_size,1,1);
+}
 
+//! Reads the matrix rows, either from text files with one row per line or
+//! from binary rows files written by gabp_convert.
+static api::DIA<double> ReadRows(
+    api::Context& ctx, const std::vector<std::string>& input_filelist, size_t y_size, bool binary) {
 
+    if(binary){
+        return ReadBinaryRows<double>(ctx, input_filelist, y_size);
+    }
 
-            for(j=0;j<y_size-1;j++){
-                results.push_back(values[i*y_size+j]);
-            }
-            if(i==1 || i==values.size()/y_size-2){
-                results.push_back(err);
-            }else{
-                results.push_back(0);
-            }
- 
+    auto lines = ReadLines(ctx, input_filelist);
 
-        }
+    return lines.template FlatMap<double>(
+        [](const std::string& line, auto emit) -> void{
+            tlx::split_view(' ', line, [&](const tlx::string_view& sv){
+                if(sv.size() == 0) return;
+                emit((double)atof(sv.to_string().c_str()));
+            });
+        }).Collapse();
+}
 
-        if(values[values.size()-y_size+BI] == 0 && values[values.size()-y_size+AI] == 0 && values[values.size()-y_size+CI] == 0){
-            for(j=0;j<y_size;j++){
-                results.push_back(values[values.size()-y_size + j]);
-            }
+//! Solver settings from the command line.
+struct GaBPOptions {
+    //! input files are binary rows files
+    bool binary = false;
+    //! iterate, intermap, soa, spike, sparse or block
+    std::string solver = "iterate";
+    //! upper bound on the number of sweeps
+    size_t max_iterations = 20000;
+    //! stop once the global residual drops below this
+    double tolerance = 0.005;
+    //! sweeps between global convergence checks, 0 disables them
+    size_t check_interval = 100;
+    //! iterate: update even and odd rows in alternating half sweeps
+    bool red_black = false;
+    //! soa: converge the precisions first, then iterate only the means
+    bool two_phase = false;
+    //! soa: recompute only rows whose messages change by more than this,
+    //! 0 recomputes all rows in every sweep
+    double active_threshold = 0;
+    //! soa: weight of the old value in each message update, 0 disables
+    double damping = 0;
+    //! soa: Aitken extrapolation of the messages every this many sweeps, 0
+    //! disables
+    size_t aitken_interval = 0;
+    //! file for the convergence trace, empty for none
+    std::string trace;
+    //! iterate: path prefix of the checkpoint files, empty for none
+    std::string checkpoint;
+    //! iterate: sweeps between checkpoints
+    size_t checkpoint_interval = 1000;
+    //! soa: precision of the messages, double or float
+    std::string precision = "double";
+    //! soa: rounds of iterative refinement with double residuals
+    size_t refinements = 0;
+    //! soa: also solve in double and report the difference
+    bool compare_double = false;
+    //! block: size of the blocks of the block-tridiagonal matrix
+    size_t block_size = 2;
+    //! soa, spike: number of right hand sides per row, more than one implies
+    //! two_phase for soa
+    size_t num_rhs = 1;
+};
+
+//! Convergence trace, written by rank 0 if --trace is given: one line
+//! "<phase> <iteration> <residual>" per convergence check.
+struct ConvergenceTrace {
+    std::shared_ptr<std::ofstream> out;
+
+    void operator () (const char* phase, size_t iter, double residual) const {
+        if(out) *out << phase << ' ' << iter << ' ' << residual << '\n';
+    }
 
+    void Comment(const std::string& text) const {
+        if(out) *out << "# " << text << '\n';
+    }
+};
+
+//! Runs the sweeps of engine in the mode selected by opt.
+template <typename Real, typename ConvergedFunction>
+static void RunSoAEngine(
+    api::Context& ctx, gabp::SoAEngine<Real>& engine, const GaBPOptions& opt,
+    const ConvergenceTrace& trace, const ConvergedFunction& converged) {
+    engine.SetDamping(opt.damping);
+    engine.SetExtrapolation(opt.aitken_interval);
+
+    if(opt.two_phase || opt.num_rhs > 1){
+        // the precisions get at most half of the sweeps, so that a slowly
+        // converging precision phase, or one without checks, leaves the
+        // means their own budget. The correction solves of the refinement
+        // reuse the frozen precisions and only run the means.
+        size_t iter = 0;
+        if(!engine.frozen()){
+            iter = engine.RunPrecisions(
+                ctx.net, opt.max_iterations / 2, opt.check_interval,
+                [&ctx, &opt, &trace](double global_err, size_t iter) {
+                    if(ctx.my_rank() == 0){
+                        std::cout << "iter " << iter << " precision err:" << global_err << std::endl;
+                        trace("precision", iter, global_err);
+                    }
+                    return global_err < opt.tolerance;
+                });
         }
-                
-        return results;
-    },y_size,1,1);
-
-    int iter = 0;
-    while(true){
-        nums = nums.InterMap2D([y_size,iter](std::vector<double> values) {
-        long start_time, end_time;
-        start_time = clock();
-        std::vector<double> results;
-        int k;
-        int i,j;
-        double err = 0;
-        err = values[X] + values[y_size+X] + values[values.size()-1];
-        if(iter % 1000 == 0){
-            std::cout << "iter " << iter << " done. err:" << err << std::endl;
+        size_t mean_iterations = opt.max_iterations - iter;
+        if(mean_iterations == 0 && ctx.my_rank() == 0){
+            std::cerr << "GaBP: no sweeps left for the means, x is not solved,"
+                      << " raise --max-iterations" << std::endl;
         }
-
- /*       if(err < 0.005){
-
-            if(values[BI] == 0 && values[AI] == 0 & values[CI] == 0){
-                for(j=0;j<y_size;j++){
-                    results.push_back(values[j]);
-                }
-            }
-
-
-            for(i=1;i<values.size()/y_size-1;i++){
-                for(j=0;j<y_size;j++){
-                    results.push_back(values[i*y_size+j]);
+        engine.RunMeans(ctx.net, mean_iterations, opt.check_interval, converged);
+    }
+    else if(opt.active_threshold > 0){
+        engine.RunActive(
+            ctx.net, opt.max_iterations, opt.check_interval, opt.active_threshold,
+            [&ctx, converged](double global_err, size_t active_rows, size_t iter) {
+                if(ctx.my_rank() == 0){
+                    std::cout << "iter " << iter << " active rows:" << active_rows << std::endl;
                 }
-            }
+                return converged(global_err, iter);
+            });
+    }
+    else {
+        engine.Run(ctx.net, opt.max_iterations, opt.check_interval, converged);
+    }
+}
 
-            if(values[values.size()-y_size+BI] == 0 && values[values.size()-y_size+AI] == 0 && values[values.size()-y_size+CI] == 0){
-                for(j=0;j<y_size;j++){
-                    results.push_back(values[values.size()-y_size + j]);
-                }
+//! Solves the rows of an InterMap2D buffer with the SoA engine working in
+//! Real, followed by up to opt.refinements rounds of iterative refinement with
+//! double residuals. Returns x of the owned rows.
+template <typename Real, typename ConvergedFunction>
+static std::vector<double> SolveSoA(
+    api::Context& ctx, const std::vector<double>& values, size_t y_size,
+    const GaBPOptions& opt, const ConvergenceTrace& trace, const ConvergedFunction& converged) {
+
+    gabp::SoAEngine<Real> engine(values, y_size, opt.num_rhs);
+    RunSoAEngine(ctx, engine, opt, trace, converged);
+    if(opt.refinements == 0) return engine.Solution();
+
+    gabp::Refinement refinement(values, y_size, opt.num_rhs);
+    std::vector<double> r;
+    // x of the round with the lowest residual so far
+    std::vector<double> best;
+    double best_residual = std::numeric_limits<double>::infinity();
+    for(size_t round = 0; ; ++round){
+        refinement.Correct(engine.Solution());
+        double residual = ctx.net.AllReduce(refinement.Residual(ctx.net, &r));
+        if(ctx.my_rank() == 0){
+            std::cout << "refinement " << round << " residual:" << residual << std::endl;
+            trace("refinement", round, residual);
+        }
+        // a correction which does not lower the residual, e.g. one solved
+        // in float below its accuracy, is dropped and the refinement stops
+        if(residual >= best_residual){
+            if(ctx.my_rank() == 0){
+                std::cout << "refinement " << round << " did not lower the residual, keeping round "
+                          << round - 1 << std::endl;
             }
+            return best;
+        }
+        if(round == opt.refinements || residual < opt.tolerance) break;
+        best = refinement.Solution();
+        best_residual = residual;
 
-            return results;
+        // solve for the correction, the engine keeps its precisions
+        engine.SetRhs(r);
+        RunSoAEngine(ctx, engine, opt, trace, converged);
+    }
+    return refinement.Solution();
+}
 
-        }*/
+//! Solves the rows again in double and prints on rank 0 how far x is from
+//! that solution, and the residuals of both.
+template <typename ConvergedFunction>
+static void ReportAccuracy(
+    api::Context& ctx, const std::vector<double>& values, size_t y_size,
+    const GaBPOptions& opt, const std::vector<double>& x,
+    const ConvergenceTrace& trace, const ConvergedFunction& converged) {
+
+    if(ctx.my_rank() == 0){
+        std::cout << "double reference run" << std::endl;
+        trace.Comment("double reference run");
+    }
+    GaBPOptions double_opt = opt;
+    double_opt.refinements = 0;
+    std::vector<double> x_double = SolveSoA<double>(ctx, values, y_size, double_opt, trace, converged);
 
-        double tmp_ui_before[values.size()/y_size];
-        double tmp_ui_after[values.size()/y_size];
-        double tmp_pi_before[values.size()/y_size];
-        double tmp_pi_after[values.size()/y_size];
+    double diff = 0;
+    for(size_t j = 0; j < x.size(); j++){
+        diff = std::max(diff, std::abs(x[j] - x_double[j]));
+    }
+    diff = ctx.net.AllReduce(diff, [](double a, double b){ return std::max(a, b); });
 
-        for(i=1;i<values.size()/y_size-1;i++){
-            tmp_ui_before[i] = values[i*y_size+B];
-            tmp_pi_before[i] = values[i*y_size+AI];
+    gabp::Refinement check(values, y_size, opt.num_rhs);
+    double residual = ctx.net.AllReduce(check.Residual(ctx.net, x, nullptr));
+    double residual_double = ctx.net.AllReduce(check.Residual(ctx.net, x_double, nullptr));
 
-            if(values[i*y_size+CI] != 0){
-                tmp_ui_before[i] = tmp_ui_before[i] + values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI];
-                tmp_pi_before[i] = tmp_pi_before[i] + values[(i+1)*y_size+PBI];
-            }
+    if(ctx.my_rank() == 0){
+        std::cout << "accuracy: max |x - x_double|:" << diff
+                  << " residual:" << residual
+                  << " double residual:" << residual_double << std::endl;
+    }
+}
 
-            if(values[i*y_size] != 0){
-                tmp_ui_before[i] = tmp_ui_before[i] + values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI];
-                tmp_pi_before[i] = tmp_pi_before[i] + values[(i-1)*y_size+PCI];
-            }
-        }
+//! Solves a general sparse system given in CSR form, one row "i b j_1 a_1
+//! j_2 a_2 ..." per line, and writes x in row order.
+static void RunSparseGaBP(
+    api::Context& ctx, std::vector<std::string>& input_filelist, const std::string& output,
+    const GaBPOptions& opt) {
+    ctx.enable_consume();
 
+    ConvergenceTrace trace;
+    if(!opt.trace.empty() && ctx.my_rank() == 0){
+        trace.out = std::make_shared<std::ofstream>(opt.trace);
+        trace.Comment("solver sparse");
+    }
 
-        if(values[BI] == 0 && values[AI] == 0 & values[CI] == 0){
-            for(j=0;j<y_size;j++){
-                results.push_back(values[j]);          
-            }
+    double tolerance = opt.tolerance;
+    auto converged = [&ctx, tolerance, trace](double global_err, size_t iter) {
+        if(ctx.my_rank() == 0){
+            std::cout << "iter " << iter << " global err:" << global_err << std::endl;
+            trace("sweep", iter, global_err);
         }
+        return global_err < tolerance;
+    };
+
+    // the rows are spread by index, the ghost lists follow from the column
+    // indexes once, then only the beliefs of the ghost rows are exchanged.
+    ReadLines(ctx, input_filelist)
+    .Filter([](const std::string& line) { return !line.empty(); })
+    .Map([](const std::string& line) { return gabp::ParseSparseRow(line); })
+    .InterMapGraph(
+        [](const gabp::SparseRow& r) { return r.id; },
+        [](const gabp::SparseRow& r) -> const std::vector<size_t>& { return r.cols; },
+        [](const gabp::SparseRow& r) { return gabp::SparseBelief(r); },
+        [](std::vector<gabp::SparseRow>& rows,
+           const api::GraphHalo<std::pair<double, double> >& halo) {
+            return gabp::SparseGaBPSweep(rows, halo);
+        },
+        opt.max_iterations, converged, opt.check_interval)
+    .Map([](const gabp::SparseRow& r){
+        return std::to_string(r.x);
+    })
+    .WriteLines(output);
+}
 
-        for(i=1;i<values.size()/y_size-1;i++){
-            values[i*y_size+PI] = values[i*y_size+AI];
-            values[i*y_size+PAI] = values[i*y_size+AI];
-            values[i*y_size+UI] = values[i*y_size+B];
-            values[i*y_size+UAI] = values[i*y_size+B]/values[i*y_size+AI];           
+//! Solves a block-tridiagonal system with K x K blocks, given as one block
+//! row "L D U b" per line with the blocks row-major, and writes the K values of
+//! x of each block row per line.
+template <size_t K>
+static void RunBlockGaBP(
+    api::Context& ctx, std::vector<std::string>& input_filelist, const std::string& output,
+    const GaBPOptions& opt) {
+    ctx.enable_consume();
 
-            if(values[i*y_size+BI] != 0){
-                values[i*y_size+PI] = values[i*y_size+PI] + values[(i-1)*y_size+PCI];
-                values[i*y_size+UI] = values[i*y_size+UI] + values[(i-1)*y_size+UCI] * values[(i-1)*y_size+PCI];
-            }
+    using Layout = gabp::BlockLayout<K>;
 
-            if(values[i*y_size+CI] != 0){
-                values[i*y_size+PI] = values[i*y_size+PI] + values[(i+1)*y_size+PBI];
-                values[i*y_size+UI] = values[i*y_size+UI] + values[(i+1)*y_size+UBI] * values[(i+1)*y_size+PBI];
-            }
+    ConvergenceTrace trace;
+    if(!opt.trace.empty() && ctx.my_rank() == 0){
+        trace.out = std::make_shared<std::ofstream>(opt.trace);
+        trace.Comment("solver block " + std::to_string(K));
+    }
 
-            if(values[i*y_size+PI] == 0) values[i*y_size+PI] = 0.00001;
-            values[i*y_size+UI] = values[i*y_size+UI] / values[i*y_size+PI];
+    double tolerance = opt.tolerance;
+    auto converged = [&ctx, tolerance, trace](double global_err, size_t iter) {
+        if(ctx.my_rank() == 0){
+            std::cout << "iter " << iter << " global err:" << global_err << std::endl;
+            trace("sweep", iter, global_err);
         }
+        return global_err < tolerance;
+    };
 
-        double tmp;
-        err = 0;
-        for(i=1;i<values.size()/y_size-1;i++){
-            if(values[i*y_size+BI] != 0){
-                tmp = (values[i*y_size+PI] - values[(i-1)*y_size+PCI]);
-                if(tmp == 0)tmp = 0.00001;
-                values[i*y_size+PBI] = -1 * values[i*y_size+BI] * values[i*y_size+BI] / tmp;
-                values[i*y_size+UBI] = (values[i*y_size+PI] * values[i*y_size+UI] - values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI]) / values[i*y_size+BI];
+    // the message and x columns are not in the input, they start at zero
+    auto rows = ReadLines(ctx, input_filelist).template FlatMap<double>(
+        [](const std::string& line, auto emit) -> void{
+            size_t count = 0;
+            tlx::split_view(' ', line, [&](const tlx::string_view& sv){
+                if(sv.size() == 0 || count == Layout::Input) return;
+                emit((double)atof(sv.to_string().c_str()));
+                ++count;
+            });
+            if(count == 0) return;
+            for(; count < Layout::Size; ++count) emit(0.0);
+        }).Collapse();
+
+    // only the messages towards this worker change in the halo rows
+    auto nums = rows.IterateInterMap(
+        [](std::vector<double>& values) {
+            return gabp::BlockGaBPSweep<K>(values);
+        }, Layout::Size, 1, 1,
+        gabp::BlockHaloFields<K>(Layout::NextP, Layout::NextH),
+        gabp::BlockHaloFields<K>(Layout::PrevP, Layout::PrevH),
+        opt.max_iterations, converged, opt.check_interval);
+
+    nums.template FlatWindow<std::string>(DisjointTag, Layout::Size,
+        [](size_t, const std::vector<double>& row, auto emit){
+            bool sentinel = true;
+            for(size_t j = 0; j < Layout::Input; ++j) sentinel = sentinel && row[j] == 0;
+            if(sentinel) return;
+
+            std::string line;
+            for(size_t j = 0; j < K; ++j){
+                if(!line.empty()) line += ' ';
+                line += std::to_string(row[Layout::Sol + j]);
             }
+            emit(line);
+        })
+    .WriteLines(output);
+}
 
-            if(values[i*y_size+CI] !=0){
-                tmp = (values[i*y_size+PI] - values[(i+1)*y_size+PBI]);
-                if(tmp == 0) tmp = 0.00001;
-                values[i*y_size+PCI] = -1 * values[i*y_size+CI] * values[i*y_size+CI] / tmp;
-                values[i*y_size+UCI] = (values[i*y_size+PI] * values[i*y_size+UI] - values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI]) / values[i*y_size+CI];
+static void RunGaBP(
+    api::Context& ctx, size_t y_size, std::vector<std::string>& input_filelist, const std::string& output,
+    const GaBPOptions& opt) {
+    ctx.enable_consume();
 
-            }
-        
+    const std::string& solver = opt.solver;
+    size_t max_iterations = opt.max_iterations;
+    double tolerance = opt.tolerance;
+    size_t check_interval = opt.check_interval;
 
-        }
+    common::StatsTimerStart timer;
 
-        for(i=1;i<values.size()/y_size-1;i++){
-            tmp_ui_after[i] = values[i*y_size+B];
-            tmp_pi_after[i] = values[i*y_size+AI];
+    auto numbers = ReadRows(ctx, input_filelist, y_size, opt.binary);
 
-            if(values[i*y_size+CI] != 0){
-                tmp_ui_after[i] = tmp_ui_after[i] + values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI];
-                tmp_pi_after[i] = tmp_pi_after[i] + values[(i+1)*y_size+PBI];
-            }
+// bi,ai,ci,Pbi,Pai,Pci,Ubi,Uai,Uci,Pi,Ui,b,x
 
-            if(values[i*y_size] != 0){
-                tmp_ui_after[i] = tmp_ui_after[i] + values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI];
-                tmp_pi_after[i] = tmp_pi_after[i] + values[(i-1)*y_size+PCI];
-            }
+    api::DIA<double> x;
 
-            double x_before = tmp_ui_before[i] / tmp_pi_before[i];
-            double x_after = tmp_ui_after[i] / tmp_pi_after[i];
-            if(x_after > x_before){
-                err += x_after - x_before;
-            }else{
-                err += x_before - x_after;
-            }
+    ConvergenceTrace trace;
+    if(!opt.trace.empty() && ctx.my_rank() == 0){
+        trace.out = std::make_shared<std::ofstream>(opt.trace);
+        trace.Comment("solver " + solver + " damping " + std::to_string(opt.damping) +
+                      " aitken " + std::to_string(opt.aitken_interval));
+    }
 
-            for(j=0;j<y_size-1;j++){
-                results.push_back(values[i*y_size+j]);
-            }
-            if(i==1 || i==values.size()/y_size-2){
-                results.push_back(err);
-            }else{
-                results.push_back(0);
-            }
+    auto converged = [&ctx, tolerance, trace](double global_err, size_t iter) {
+        if(ctx.my_rank() == 0){
+            std::cout << "iter " << iter << " global err:" << global_err << std::endl;
+            trace("sweep", iter, global_err);
         }
-
-        if(values[values.size()-y_size+BI] == 0 && values[values.size()-y_size+AI] == 0 && values[values.size()-y_size+CI] == 0){
-            for(j=0;j<y_size;j++){
-                results.push_back(values[values.size()-y_size + j]);
+        return global_err < tolerance;
+    };
+
+    if(solver == "soa"){
+        // all sweeps run inside one InterMap2D call on the SoA copy of the
+        // rows, the engine exchanges the boundary messages itself.
+        x = numbers.InterMap2D([&ctx, y_size, &opt, &trace, converged](std::vector<double> values) {
+            if(opt.precision == "float"){
+                std::vector<double> x = SolveSoA<float>(ctx, values, y_size, opt, trace, converged);
+                if(opt.compare_double) ReportAccuracy(ctx, values, y_size, opt, x, trace, converged);
+                return x;
             }
-
-        }
-        end_time = clock();
-//        std::cout << "iter " << iter << " run time is " << (end_time - start_time)/1000000 << "ms" << std::endl;
-                return results;
-
+            return SolveSoA<double>(ctx, values, y_size, opt, trace, converged);
         },y_size,1,1);
-        if(++iter > 20000) break;
     }
-
-    nums = nums.InterMap2D([y_size](std::vector<double> values) {
-        std::vector<double> results;
-        int i;
-
-        for(i=1;i<values.size()/y_size-1;i++){
-            values[i*y_size+PI] = values[i*y_size+AI];
-            values[i*y_size+UI] = values[i*y_size+B];
-
-            if(values[i*y_size+CI] != 0){
-                values[i*y_size+PI] = values[i*y_size+PI] + values[(i+1)*y_size+PBI];
-                values[i*y_size+UI] = values[i*y_size+UI] + values[(i+1)*y_size+PBI] * values[(i+1)*y_size+UBI];
-            }
-
-            if(values[i*y_size] != 0){
-                values[i*y_size+PI] = values[i*y_size+PI] + values[(i-1)*y_size+PCI];
-                values[i*y_size+UI] = values[i*y_size+UI] + values[(i-1)*y_size+PCI] * values[(i-1)*y_size+UCI];
+    else if(solver == "spike"){
+        // direct solve of the tridiagonal system, one AllGather of the
+        // boundary coefficients instead of the sweeps.
+        x = numbers.InterMap2D([&ctx, y_size, &opt](std::vector<double> values) {
+            gabp::SpikeSolver spike(values, y_size, opt.num_rhs);
+            spike.Solve(ctx.net);
+            return spike.Solution();
+        },y_size,1,1);
+    }
+    else if(solver == "iterate" && opt.red_black){
+        // each call of the function is a half sweep over one colour, so
+        // that the halo rows are exchanged between the two halves. The
+        // global index of the first inner row decides the colour of the rows.
+        size_t first = std::numeric_limits<size_t>::max();
+        double red_err = 0;
+        size_t half = 0;
+        auto nums = numbers.IterateInterMap(
+            [&ctx, y_size, first, red_err, half](std::vector<double>& values) mutable {
+                if(first == std::numeric_limits<size_t>::max()){
+                    size_t rows = values.size() / y_size;
+                    first = ctx.net.ExPrefixSum(rows >= 2 ? rows - 2 : 0);
+                }
+                double err = GaBPColorSweep(values, y_size, first, half++ % 2);
+                if(half % 2 == 1){
+                    red_err = err;
+                    return err;
+                }
+                // the residual of a full sweep covers both colours
+                return red_err + err;
+            }, y_size, 1, 1,
+            std::vector<size_t>{ PCI, UCI }, std::vector<size_t>{ PBI, UBI },
+            2 * max_iterations,
+            [converged](double global_err, size_t iter) {
+                return converged(global_err, iter / 2);
+            }, 2 * check_interval);
+        x = GaBPSolution(nums, y_size);
+    }
+    else if(solver == "iterate" && !opt.checkpoint.empty()){
+        // the messages are the only state which changes between sweeps. A
+        // checkpoint is taken at the start of a sweep, after the halo
+        // exchange, so on restart the first call restores the messages of
+        // the own and the halo rows and sweeps on as the original run did.
+        // the checkpoints only fit this input and iteration schedule: each
+        // input value is hashed with its worker and position, and the sum of
+        // the hashes is mixed with the options.
+        size_t index = 0;
+        uint64_t fingerprint = numbers.Keep().Map(
+            [&ctx, &index](const double& v) {
+                uint64_t bits;
+                std::memcpy(&bits, &v, sizeof(bits));
+                return gabp::FingerprintMix(gabp::FingerprintMix(ctx.my_rank(), index++), bits);
+            }).Sum();
+        fingerprint = gabp::FingerprintMix(gabp::FingerprintMix(fingerprint, max_iterations), check_interval);
+
+        auto checkpoint = std::make_shared<gabp::Checkpoint>(
+            opt.checkpoint, std::vector<size_t>{ PBI, PCI, UBI, UCI },
+            y_size, ctx.my_rank(), ctx.num_workers(), fingerprint);
+        size_t start = checkpoint->Latest(ctx.net);
+        // the checkpoints are taken before a sweep, so a matching one is
+        // always below max_iterations, without a sweep nothing is restored
+        if(start >= max_iterations)
+            die("GaBP: checkpoint at iter " + std::to_string(start) + " is not below --iterations");
+        if(start > 0 && ctx.my_rank() == 0)
+            std::cout << "restart from checkpoint at iter " << start << std::endl;
+        size_t done = start;
+        bool restore = start > 0;
+        size_t interval = opt.checkpoint_interval;
+
+        auto nums = numbers.IterateInterMap(
+            [y_size, checkpoint, done, restore, interval](std::vector<double>& values) mutable {
+                if(restore){
+                    restore = false;
+                    if(!checkpoint->Restore(values))
+                        die("GaBP: checkpoint does not fit the input");
+                }
+                else if(done > 0 && done % interval == 0){
+                    checkpoint->Save(done, values);
+                }
+                ++done;
+                return GaBPSweep(values, y_size);
+            }, y_size, 1, 1,
+            std::vector<size_t>{ PCI, UCI }, std::vector<size_t>{ PBI, UBI },
+            max_iterations, converged, check_interval, start);
+        x = GaBPSolution(nums, y_size);
+    }
+    else if(solver == "iterate"){
+        // the rows stay resident in one buffer, only the halo rows are
+        // exchanged between the sweeps. A sweep reads the messages PCI/UCI
+        // from the row above and PBI/UBI from the row below, the rest of the
+        // halo rows is constant after the first exchange.
+        auto nums = numbers.IterateInterMap(
+            [y_size](std::vector<double>& values) {
+                return GaBPSweep(values, y_size);
+            }, y_size, 1, 1,
+            std::vector<size_t>{ PCI, UCI }, std::vector<size_t>{ PBI, UBI },
+            max_iterations, converged, check_interval);
+        x = GaBPSolution(nums, y_size);
+    }
+    else {
+        // each sweep returns its residual next to the rows, the stage sums it
+        // up over all workers into global_err when it runs.
+        double global_err = std::numeric_limits<double>::max();
+        // the sweep works on the worker's rows in the output of the stage and
+        // reads the halo rows from its input, nothing else is copied.
+        auto sweep = [y_size](common::Span<const double> input, size_t up,
+                              common::Span<double> output) {
+            std::copy(input.begin() + up, input.begin() + up + output.size(),
+                      output.begin());
+            size_t first = up / y_size, last = first + output.size() / y_size;
+            auto row = [output, first, y_size](size_t i) {
+                return &output[(i-first)*y_size];
+            };
+            auto halo = [input, output, first, last, y_size](size_t i) -> const double* {
+                if(i >= first && i < last) return &output[(i-first)*y_size];
+                return &input[i*y_size];
+            };
+            return GaBPSweepRows(input.size() / y_size, row, halo);
+        };
+
+        api::DIA<double> nums = numbers.InterMap2DAllReduce(sweep, y_size, 1, 1, global_err);
+
+        size_t iter = 0;
+        while(true){
+            nums = nums.InterMap2DAllReduce(sweep, y_size, 1, 1, global_err);
+            if(++iter > max_iterations) break;
+
+            if(check_interval != 0 && iter % check_interval == 0){
+                // InterMap2D runs its function when the child pulls the data, so
+                // executing nums runs all pending sweeps up to the previous one.
+                nums.Execute();
+                if(ctx.my_rank() == 0){
+                    std::cout << "iter " << iter << " global err:" << global_err << std::endl;
+                    trace("sweep", iter, global_err);
+                }
+                // all workers see the same reduced value and stop together
+                if(global_err < tolerance) break;
             }
-            values[i*y_size+X] = values[i*y_size+UI] / values[i*y_size+PI];
-            results.push_back(values[i*y_size+X]);
         }
- 
-        //for(i=1;i<values.size()/y_size-1;i++){
-        //   std::cout << "x[" << i << "]=" << values[i*y_size+X] << " ";
-        //}  
-        return results;
-        },y_size,1,1);
-        
+        x = GaBPSolution(nums, y_size);
+    }
 
-    nums.Map([](const double num){
+    if(opt.num_rhs == 1){
+        x.Map([](const double num){
 
-        return std::to_string(num);
-    })
-    .WriteLines(output);
+            return std::to_string(num);
+        })
+        .WriteLines(output);
+    }
+    else {
+        // one line per row with the solutions of all right hand sides
+        x.Window(DisjointTag, opt.num_rhs, [](size_t, const std::vector<double>& nums){
+            std::string line;
+            for(const double& num : nums){
+                if(!line.empty()) line += ' ';
+                line += std::to_string(num);
+            }
+            return line;
+        })
+        .WriteLines(output);
+    }
 
 
 }
@@ -391,6 +763,43 @@ int main(int argc, char* argv[]) {
     std::string output;
     clp.add_string('o', "output", output,
                    "output file pattern");
+    GaBPOptions opt;
+    clp.add_flag('b', "binary", opt.binary,
+                 "input files are binary rows files written by gabp_convert");
+    clp.add_string('s', "solver", opt.solver,
+                   "iterate (resident IterateInterMap), intermap (one InterMap2D per sweep), soa (vectorized engine), spike (exact tridiagonal solve), sparse (general sparse matrix in CSR rows \"i b j a ...\") or block (block-tridiagonal rows \"L D U b\"), default: iterate");
+    clp.add_size_t('B', "block-size", opt.block_size,
+                   "block: size k of the k x k blocks, 2, 3, 4 or 8, default: 2");
+    clp.add_size_t('i', "iterations", opt.max_iterations,
+                   "maximum number of GaBP sweeps, default: 20000");
+    clp.add_double('e', "tolerance", opt.tolerance,
+                   "stop once the global residual drops below this, default: 0.005");
+    clp.add_size_t('c', "check-interval", opt.check_interval,
+                   "sweeps between global convergence checks, 0 disables, default: 100");
+    clp.add_flag('R', "red-black", opt.red_black,
+                 "iterate: update even and odd rows in alternating half sweeps with a halo exchange in between");
+    clp.add_flag('t', "two-phase", opt.two_phase,
+                 "soa: converge the precisions first, then iterate only the means");
+    clp.add_double('a', "active-threshold", opt.active_threshold,
+                   "soa: only recompute rows whose messages change by more than this, default: 0 (all rows)");
+    clp.add_double('d', "damping", opt.damping,
+                   "soa: weight of the old message in each update, in [0, 1), default: 0");
+    clp.add_size_t('x', "aitken", opt.aitken_interval,
+                   "soa: Aitken extrapolation of the messages every this many sweeps (>= 3), default: 0 (off)");
+    clp.add_string("trace", opt.trace,
+                   "write the residual of each convergence check to this file");
+    clp.add_string("checkpoint", opt.checkpoint,
+                   "iterate: checkpoint the messages to files with this prefix in the background and restart from the latest complete checkpoint");
+    clp.add_size_t("checkpoint-interval", opt.checkpoint_interval,
+                   "iterate: sweeps between checkpoints, default: 1000");
+    clp.add_string('p', "precision", opt.precision,
+                   "soa: precision of the messages, double or float, default: double");
+    clp.add_size_t('r', "refine", opt.refinements,
+                   "soa: rounds of iterative refinement of x with double residuals, default: 0");
+    clp.add_flag("compare", opt.compare_double,
+                 "soa, float: also solve in double and report the difference");
+    clp.add_size_t('k', "rhs", opt.num_rhs,
+                   "soa, spike: number of right hand sides b_0..b_{k-1} per row, default: 1");
     std::vector<std::string> input;
     clp.add_param_stringlist("input", input,
                              "input file pattern(s)");
@@ -401,10 +810,80 @@ int main(int argc, char* argv[]) {
 
     clp.print_result();
 
+    if(opt.solver != "iterate" && opt.solver != "intermap" && opt.solver != "soa" &&
+       opt.solver != "spike" && opt.solver != "sparse" && opt.solver != "block"){
+        std::cerr << "GaBP: unknown --solver " << opt.solver
+                  << ", use iterate, intermap, soa, spike, sparse or block" << std::endl;
+        clp.print_usage();
+        return -1;
+    }
+
+    if(opt.num_rhs == 0 || (opt.num_rhs > 1 && opt.solver != "soa" && opt.solver != "spike")){
+        std::cerr << "GaBP: several right hand sides need --solver soa or spike" << std::endl;
+        return -1;
+    }
+
+    if(opt.precision != "double" && (opt.precision != "float" || opt.solver != "soa")){
+        std::cerr << "GaBP: --precision float needs --solver soa" << std::endl;
+        return -1;
+    }
+
+    if(opt.damping < 0 || opt.damping >= 1 || opt.aitken_interval == 1 || opt.aitken_interval == 2){
+        std::cerr << "GaBP: --damping must be in [0, 1) and --aitken 0 or at least 3" << std::endl;
+        return -1;
+    }
+
+    if((opt.damping != 0 || opt.aitken_interval != 0) && opt.solver != "soa"){
+        std::cerr << "GaBP: --damping and --aitken need --solver soa" << std::endl;
+        return -1;
+    }
+
+    if((opt.solver == "sparse" || opt.solver == "block") && opt.binary){
+        std::cerr << "GaBP: --solver sparse and block read text rows only" << std::endl;
+        return -1;
+    }
+
+    if(opt.solver == "block" && opt.block_size != 2 && opt.block_size != 3 &&
+       opt.block_size != 4 && opt.block_size != 8){
+        std::cerr << "GaBP: --block-size must be 2, 3, 4 or 8" << std::endl;
+        return -1;
+    }
+
+    if(!opt.checkpoint.empty() && (opt.solver != "iterate" || opt.red_black || opt.checkpoint_interval == 0)){
+        std::cerr << "GaBP: --checkpoint needs --solver iterate without --red-black and a nonzero --checkpoint-interval" << std::endl;
+        return -1;
+    }
+
+    if(opt.red_black && opt.solver != "iterate"){
+        std::cerr << "GaBP: --red-black needs --solver iterate" << std::endl;
+        return -1;
+    }
+
+    if(opt.active_threshold > 0 && (opt.solver != "soa" || opt.two_phase || opt.num_rhs > 1)){
+        std::cerr << "GaBP: --active-threshold needs --solver soa with one right hand side and without --two-phase" << std::endl;
+        return -1;
+    }
+
+    if(opt.active_threshold > 0 && opt.aitken_interval != 0){
+        std::cerr << "GaBP: --aitken does not work with --active-threshold, which updates only some rows per sweep" << std::endl;
+        return -1;
+    }
+
     return api::Run(
         [&](api::Context& ctx) {
 
-           RunGaBP(ctx, 13, input,output);
+           if(opt.solver == "sparse")
+               RunSparseGaBP(ctx, input, output, opt);
+           else if(opt.solver == "block" && opt.block_size == 2)
+               RunBlockGaBP<2>(ctx, input, output, opt);
+           else if(opt.solver == "block" && opt.block_size == 3)
+               RunBlockGaBP<3>(ctx, input, output, opt);
+           else if(opt.solver == "block" && opt.block_size == 4)
+               RunBlockGaBP<4>(ctx, input, output, opt);
+           else if(opt.solver == "block" && opt.block_size == 8)
+               RunBlockGaBP<8>(ctx, input, output, opt);
+           else
+               RunGaBP(ctx, ROW_SIZE + opt.num_rhs - 1, input,output, opt);
          
         });
 }
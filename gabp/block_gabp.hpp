@@ -0,0 +1,203 @@
+/*******************************************************************************
+ * gabp/block_gabp.hpp
+ *
+ * GaBP for symmetric block-tridiagonal systems with small dense K x K blocks,
+ * e.g. from PDEs with K components per grid point. The messages are K x K
+ * precision matrices and K-vectors, K is a template parameter so that the
+ * block kernels are fully unrolled.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_BLOCK_GABP_HEADER
+#define GABP_BLOCK_GABP_HEADER
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace gabp {
+
+/*!
+ * Columns of a block row of K x K blocks, all blocks row-major: the blocks
+ * left of (Lower), on (Diag) and right of (Upper) the diagonal, the right hand
+ * side (Rhs), the message to the previous block row (precision PrevP, mean
+ * information PrevH), the message to the next block row (NextP, NextH) and x
+ * (Sol). The names differ from the scalar columns, which are macros.
+ *
+ * Block row i stands for L x_{i-1} + D x_i + U x_{i+1} = b. As the matrix is
+ * symmetric, L of row i is U of row i-1 transposed. The input holds L, D, U
+ * and b, the first Input columns, one block row per line, with all-zero
+ * sentinel rows at both ends as for the scalar rows.
+ */
+template <size_t K>
+struct BlockLayout {
+    static constexpr size_t KK = K * K;
+
+    static constexpr size_t Lower = 0;
+    static constexpr size_t Diag = KK;
+    static constexpr size_t Upper = 2 * KK;
+    static constexpr size_t Rhs = 3 * KK;
+    static constexpr size_t PrevP = 3 * KK + K;
+    static constexpr size_t PrevH = 4 * KK + K;
+    static constexpr size_t NextP = 4 * KK + 2 * K;
+    static constexpr size_t NextH = 5 * KK + 2 * K;
+    static constexpr size_t Sol = 5 * KK + 3 * K;
+
+    //! columns of a block row
+    static constexpr size_t Size = 5 * KK + 4 * K;
+    //! columns given in the input
+    static constexpr size_t Input = 3 * KK + K;
+};
+
+/*!
+ * Dense K x K kernels on row-major blocks held in std::array, so that for the
+ * small K the loops unroll and the blocks stay in registers.
+ */
+template <size_t K>
+struct BlockKernels {
+    using Matrix = std::array<double, K * K>;
+    using Vector = std::array<double, K>;
+
+    //! Cholesky factor of the symmetric positive definite a, in place in the
+    //! lower triangle. Non-positive pivots are replaced by 0.00001 as in the
+    //! scalar sweeps.
+    static void Cholesky(Matrix& a) {
+        for (size_t j = 0; j < K; ++j) {
+            double d = a[j * K + j];
+            for (size_t k = 0; k < j; ++k) d -= a[j * K + k] * a[j * K + k];
+            d = std::sqrt(d > 0 ? d : 0.00001);
+            a[j * K + j] = d;
+            for (size_t i = j + 1; i < K; ++i) {
+                double s = a[i * K + j];
+                for (size_t k = 0; k < j; ++k) s -= a[i * K + k] * a[j * K + k];
+                a[i * K + j] = s / d;
+            }
+        }
+    }
+
+    //! Solves c c^T y = v for the factor c of Cholesky(), in place.
+    static void Solve(const Matrix& c, double* v, size_t stride) {
+        for (size_t i = 0; i < K; ++i) {
+            double s = v[i * stride];
+            for (size_t k = 0; k < i; ++k) s -= c[i * K + k] * v[k * stride];
+            v[i * stride] = s / c[i * K + i];
+        }
+        for (size_t i = K; i-- > 0; ) {
+            double s = v[i * stride];
+            for (size_t k = i + 1; k < K; ++k) s -= c[k * K + i] * v[k * stride];
+            v[i * stride] = s / c[i * K + i];
+        }
+    }
+
+    /*!
+     * The message through the coupling block a out of a row with cavity
+     * precision p and mean information h (p is overwritten):
+     *
+     *   P_msg = -a^T p^{-1} a,  h_msg = -a^T p^{-1} h.
+     */
+    static void Message(Matrix& p, const Vector& h, const double* a,
+                        double* msg_p, double* msg_h) {
+        Cholesky(p);
+        Matrix w;
+        Vector y = h;
+        for (size_t j = 0; j < K * K; ++j) w[j] = a[j];
+        for (size_t j = 0; j < K; ++j) Solve(p, &w[j], K);
+        Solve(p, y.data(), 1);
+        for (size_t i = 0; i < K; ++i) {
+            for (size_t j = 0; j < K; ++j) {
+                double s = 0;
+                for (size_t k = 0; k < K; ++k) s += a[k * K + i] * w[k * K + j];
+                msg_p[i * K + j] = -s;
+            }
+            double s = 0;
+            for (size_t k = 0; k < K; ++k) s += a[k * K + i] * y[k];
+            msg_h[i] = -s;
+        }
+    }
+};
+
+/*!
+ * Cavity of block row row without the message of one neighbour: D plus the
+ * precision of the message from the other neighbour, and b plus its mean
+ * information.
+ */
+template <size_t K>
+static inline void BlockCavity(const double* row, const double* msg_p,
+                               const double* msg_h,
+                               typename BlockKernels<K>::Matrix& p,
+                               typename BlockKernels<K>::Vector& h) {
+    using Layout = BlockLayout<K>;
+    for (size_t j = 0; j < K * K; ++j) p[j] = row[Layout::Diag + j] + msg_p[j];
+    for (size_t j = 0; j < K; ++j) h[j] = row[Layout::Rhs + j] + msg_h[j];
+}
+
+/*!
+ * One sweep over the block rows of values, with the halo or sentinel rows
+ * first and last as for GaBPSweep. The messages to the next rows are updated
+ * top down, each using the message just computed for the row above, and the
+ * messages to the previous rows bottom up, so that one sweep solves the local
+ * part of the chain exactly for the given halo messages. x of the inner rows
+ * is kept in the Sol columns, returns its summed change.
+ */
+template <size_t K>
+static double BlockGaBPSweep(std::vector<double>& values) {
+    using Layout = BlockLayout<K>;
+    using Kernels = BlockKernels<K>;
+    constexpr size_t size = Layout::Size;
+
+    size_t rows = values.size() / size;
+    if (rows < 3) return 0;
+
+    typename Kernels::Matrix p;
+    typename Kernels::Vector h;
+
+    for (size_t i = 1; i < rows - 1; ++i) {
+        double* row = &values[i * size];
+        const double* up = row - size;
+        BlockCavity<K>(row, up + Layout::NextP, up + Layout::NextH, p, h);
+        Kernels::Message(p, h, row + Layout::Upper, row + Layout::NextP, row + Layout::NextH);
+    }
+    for (size_t i = rows - 1; i-- > 1; ) {
+        double* row = &values[i * size];
+        const double* down = row + size;
+        BlockCavity<K>(row, down + Layout::PrevP, down + Layout::PrevH, p, h);
+        Kernels::Message(p, h, row + Layout::Lower, row + Layout::PrevP, row + Layout::PrevH);
+    }
+
+    double err = 0;
+    for (size_t i = 1; i < rows - 1; ++i) {
+        double* row = &values[i * size];
+        const double* up = row - size;
+        const double* down = row + size;
+        BlockCavity<K>(row, up + Layout::NextP, up + Layout::NextH, p, h);
+        for (size_t j = 0; j < K * K; ++j) p[j] += down[Layout::PrevP + j];
+        for (size_t j = 0; j < K; ++j) h[j] += down[Layout::PrevH + j];
+        Kernels::Cholesky(p);
+        Kernels::Solve(p, h.data(), 1);
+        for (size_t j = 0; j < K; ++j) {
+            err += std::fabs(h[j] - row[Layout::Sol + j]);
+            row[Layout::Sol + j] = h[j];
+        }
+    }
+    return err;
+}
+
+//! Columns of the halo rows a sweep reads and which change between sweeps:
+//! the messages to the next row of the row above and the messages to the
+//! previous row of the row below.
+template <size_t K>
+static inline std::vector<size_t> BlockHaloFields(size_t p, size_t h) {
+    std::vector<size_t> fields;
+    for (size_t j = 0; j < K * K; ++j) fields.push_back(p + j);
+    for (size_t j = 0; j < K; ++j) fields.push_back(h + j);
+    return fields;
+}
+
+} // namespace gabp
+
+#endif // !GABP_BLOCK_GABP_HEADER
+
+/******************************************************************************/
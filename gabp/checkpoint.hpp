@@ -0,0 +1,330 @@
+/*******************************************************************************
+ * gabp/checkpoint.hpp
+ *
+ * Checkpoints of the iteration state of each worker's partition, written in
+ * the background through the vfs layer, and restart from the latest
+ * checkpoint which is complete on all workers.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_CHECKPOINT_HEADER
+#define GABP_CHECKPOINT_HEADER
+
+#include <thrill/common/system_exception.hpp>
+#include <thrill/net/flow_control_channel.hpp>
+#include <thrill/vfs/file_io.hpp>
+
+#include <tlx/die.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gabp {
+
+/*!
+ * Header of a checkpoint file. It is followed by the saved values in host byte
+ * order and by the iteration once more, which is written last: a file whose
+ * trailer does not match the header was not written completely.
+ */
+struct CheckpointHeader {
+    //! "GABPCKP" and the format version
+    char     magic[8];
+    //! number of iterations done when the checkpoint was taken
+    uint64_t iteration;
+    //! worker which wrote the file and the number of workers
+    uint64_t worker, num_workers;
+    //! number of saved values
+    uint64_t values;
+    //! fingerprint of the input and the options of the run, see Checkpoint
+    uint64_t fingerprint;
+
+    static constexpr const char* magic_v3 = "GABPCKP3";
+
+    bool IsValid() const {
+        return std::memcmp(magic, magic_v3, sizeof(magic)) == 0;
+    }
+};
+
+static_assert(sizeof(CheckpointHeader) == 48,
+              "CheckpointHeader must not contain padding");
+
+//! Mixes v into the fingerprint h, with the finalizer of splitmix64.
+inline uint64_t FingerprintMix(uint64_t h, uint64_t v) {
+    uint64_t z = h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/*!
+ * Saves and restores the columns fields of the rows of row_size values of an
+ * iteration buffer, e.g. the messages of the GaBP rows. The other columns are
+ * the input and are read again on restart, so a checkpoint only holds the
+ * state which changes between iterations.
+ *
+ * Each worker alternates between two files, FillFilePattern(prefix, rank,
+ * slot) with slot 0 and 1, so the previous checkpoint stays intact while the
+ * next one is written. Save() copies the columns and returns, a background
+ * thread writes them. If the previous checkpoint is still being written, Save()
+ * waits for it first.
+ *
+ * Each checkpoint is a full snapshot of the columns, not a delta against the
+ * other file. Every GaBP sweep changes the messages of all rows, so a delta
+ * would hold about as many values, and a restart would then depend on both
+ * files being intact.
+ *
+ * A restart must run with the same input and number of workers, such that the
+ * buffers have the same layout. Files of another layout are ignored, and so
+ * are files whose fingerprint differs from the one given to the constructor.
+ * The caller derives it from the input and from the options which decide
+ * the iteration schedule, e.g. with FingerprintMix(), so that a run on
+ * another right hand side of the same size starts afresh.
+ */
+class Checkpoint
+{
+public:
+    Checkpoint(const std::string& prefix, const std::vector<size_t>& fields,
+               size_t row_size, size_t rank, size_t num_workers,
+               uint64_t fingerprint)
+        : prefix_(prefix), fields_(fields), row_size_(row_size),
+          rank_(rank), num_workers_(num_workers), fingerprint_(fingerprint),
+          writer_([this]() { Writer(); }) { }
+
+    //! non-copyable: the writer thread refers to this
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator = (const Checkpoint&) = delete;
+
+    ~Checkpoint() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        writer_.join();
+    }
+
+    /*!
+     * Finds the latest checkpoint which is complete on all workers and
+     * returns its iteration, 0 if there is none. Collective, as the workers
+     * agree on the iteration.
+     */
+    size_t Latest(thrill::net::FlowControlChannel& net) {
+        std::vector<size_t> mine;
+        for (size_t slot = 0; slot < 2; ++slot) {
+            CheckpointHeader header;
+            if (ReadHeader(Path(slot), header))
+                mine.push_back(header.iteration);
+        }
+
+        auto all = net.AllGather(mine);
+        size_t latest = 0;
+        for (const size_t& iter : mine) {
+            bool everywhere = true;
+            for (const std::vector<size_t>& other : *all) {
+                everywhere = everywhere &&
+                             std::find(other.begin(), other.end(), iter) != other.end();
+            }
+            if (everywhere) latest = std::max(latest, iter);
+        }
+        restore_iteration_ = latest;
+        return latest;
+    }
+
+    /*!
+     * Overwrites the saved columns of values with the checkpoint found by
+     * Latest(). Returns false, and leaves values alone, if there is none or
+     * it does not fit the buffer.
+     */
+    bool Restore(std::vector<double>& values) {
+        if (restore_iteration_ == 0) return false;
+        for (size_t slot = 0; slot < 2; ++slot) {
+            CheckpointHeader header;
+            if (!ReadHeader(Path(slot), header) ||
+                header.iteration != restore_iteration_ ||
+                header.values != Count(values))
+                continue;
+
+            std::vector<double> saved(header.values);
+            thrill::vfs::ReadStreamPtr stream =
+                thrill::vfs::OpenReadStream(Path(slot));
+            ReadFully(stream, &header, sizeof(header), Path(slot));
+            ReadFully(stream, saved.data(), saved.size() * sizeof(double),
+                      Path(slot));
+            stream->close();
+
+            Scatter(saved, values);
+            // the next checkpoint goes to the other file
+            next_slot_ = 1 - slot;
+            return true;
+        }
+        return false;
+    }
+
+    //! Takes a checkpoint of values after iteration iterations.
+    void Save(size_t iteration, const std::vector<double>& values) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !pending_; });
+        Gather(values, buffer_);
+        iteration_ = iteration;
+        pending_ = true;
+        lock.unlock();
+        cv_.notify_all();
+    }
+
+    //! Waits until the last checkpoint is written.
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !pending_; });
+    }
+
+private:
+    std::string prefix_;
+    std::vector<size_t> fields_;
+    size_t row_size_;
+    size_t rank_, num_workers_;
+    uint64_t fingerprint_;
+
+    //! iteration of the checkpoint found by Latest()
+    size_t restore_iteration_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    //! a checkpoint waits in buffer_ or is being written
+    bool pending_ = false;
+    bool stop_ = false;
+    std::vector<double> buffer_;
+    size_t iteration_ = 0;
+    //! file the next checkpoint is written to, only used by the writer
+    size_t next_slot_ = 0;
+
+    //! declared last, the thread starts once the members above exist
+    std::thread writer_;
+
+    std::string Path(size_t slot) const {
+        return thrill::vfs::FillFilePattern(prefix_, rank_, slot);
+    }
+
+    size_t Count(const std::vector<double>& values) const {
+        return values.size() / row_size_ * fields_.size();
+    }
+
+    void Gather(const std::vector<double>& values, std::vector<double>& out) const {
+        out.resize(Count(values));
+        size_t k = 0;
+        for (size_t r = 0; r < values.size() / row_size_; ++r) {
+            for (const size_t& f : fields_) out[k++] = values[r * row_size_ + f];
+        }
+    }
+
+    void Scatter(const std::vector<double>& saved, std::vector<double>& values) const {
+        size_t k = 0;
+        for (size_t r = 0; r < values.size() / row_size_; ++r) {
+            for (const size_t& f : fields_) values[r * row_size_ + f] = saved[k++];
+        }
+    }
+
+    //! Writes the pending checkpoints until the destructor stops the thread.
+    void Writer() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this]() { return pending_ || stop_; });
+            if (!pending_) return;
+
+            // Save() waits while pending_ is set, so buffer_ stays as it is
+            lock.unlock();
+            Write(Path(next_slot_));
+            next_slot_ = 1 - next_slot_;
+            lock.lock();
+
+            pending_ = false;
+            cv_.notify_all();
+        }
+    }
+
+    void Write(const std::string& path) const {
+        CheckpointHeader header;
+        std::memcpy(header.magic, CheckpointHeader::magic_v3, sizeof(header.magic));
+        header.iteration = iteration_;
+        header.worker = rank_;
+        header.num_workers = num_workers_;
+        header.values = buffer_.size();
+        header.fingerprint = fingerprint_;
+        uint64_t trailer = iteration_;
+
+        thrill::vfs::WriteStreamPtr stream = thrill::vfs::OpenWriteStream(path);
+        WriteFully(stream, &header, sizeof(header), path);
+        WriteFully(stream, buffer_.data(), buffer_.size() * sizeof(double), path);
+        WriteFully(stream, &trailer, sizeof(trailer), path);
+        stream->close();
+    }
+
+    //! Reads the header of the checkpoint at path and checks that the file is
+    //! complete and belongs to this worker and run.
+    bool ReadHeader(const std::string& path, CheckpointHeader& header) const {
+        if (thrill::vfs::Glob(path, thrill::vfs::GlobType::File).empty())
+            return false;
+
+        thrill::vfs::ReadStreamPtr stream = thrill::vfs::OpenReadStream(path);
+        bool ok = Read(stream, &header, sizeof(header)) &&
+                  header.IsValid() && header.worker == rank_ &&
+                  header.num_workers == num_workers_ &&
+                  header.fingerprint == fingerprint_;
+        if (ok) {
+            // skip the values and compare the trailer
+            std::vector<double> skip(std::min<uint64_t>(header.values, 1 << 16));
+            uint64_t remain = header.values, trailer = 0;
+            while (ok && remain > 0) {
+                size_t n = std::min<uint64_t>(remain, skip.size());
+                ok = Read(stream, skip.data(), n * sizeof(double));
+                remain -= n;
+            }
+            ok = ok && Read(stream, &trailer, sizeof(trailer)) &&
+                 trailer == header.iteration;
+        }
+        stream->close();
+        return ok;
+    }
+
+    //! Reads size bytes, returns false at the end of the file.
+    static bool Read(thrill::vfs::ReadStreamPtr& stream, void* data, size_t size) {
+        char* ptr = reinterpret_cast<char*>(data);
+        while (size > 0) {
+            ssize_t rb = stream->read(ptr, size);
+            if (rb <= 0) return false;
+            ptr += rb, size -= rb;
+        }
+        return true;
+    }
+
+    static void ReadFully(thrill::vfs::ReadStreamPtr& stream, void* data,
+                          size_t size, const std::string& path) {
+        if (!Read(stream, data, size))
+            die("Checkpoint: unexpected end of file in " + path);
+    }
+
+    static void WriteFully(thrill::vfs::WriteStreamPtr& stream, const void* data,
+                           size_t size, const std::string& path) {
+        const char* ptr = reinterpret_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t wb = stream->write(ptr, size);
+            if (wb < 0)
+                throw thrill::common::ErrnoException(
+                          "Error writing vfs file " + path);
+            ptr += wb, size -= wb;
+        }
+    }
+};
+
+} // namespace gabp
+
+#endif // !GABP_CHECKPOINT_HEADER
+
+/******************************************************************************/
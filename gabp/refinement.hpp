@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * gabp/refinement.hpp
+ *
+ * Double precision residuals of a tridiagonal system, for the iterative
+ * refinement of solutions computed in float and for comparing the accuracy of
+ * the solver modes.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_REFINEMENT_HEADER
+#define GABP_REFINEMENT_HEADER
+
+#include <thrill/net/flow_control_channel.hpp>
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+// after all other headers, the column names are plain macros
+#include "row_layout.hpp"
+
+namespace gabp {
+
+/*!
+ * Keeps a double copy of the owned rows of an InterMap2D(ROW_SIZE, 1, 1)
+ * buffer, as SoAEngine does, and a double solution x, K values per row.
+ *
+ * For iterative refinement, x starts at zero. Each round, a (float) solver
+ * solves A d = r with r = b - A x. The correction is added with Correct(), and
+ * Residual() gives the right hand side of the next round. The rounding errors
+ * of the solver then only enter the corrections, x and r keep double
+ * precision.
+ */
+class Refinement
+{
+public:
+    Refinement(const std::vector<double>& values, size_t row_size,
+               size_t num_rhs = 1)
+        : k_(num_rhs) {
+        size_t rows = values.size() / row_size;
+        n_ = rows >= 2 ? rows - 2 : 0;
+
+        bi_.resize(n_), ai_.resize(n_), ci_.resize(n_);
+        b_.resize(n_ * k_);
+        x_.assign(n_ * k_, 0.0);
+        for (size_t i = 0; i < n_; ++i) {
+            const double* row = values.data() + (i + 1) * row_size;
+            bi_[i] = row[BI], ai_[i] = row[AI], ci_[i] = row[CI];
+            for (size_t k = 0; k < k_; ++k)
+                b_[i * k_ + k] = row[B + k];
+        }
+    }
+
+    //! Adds the correction d, K values per row, to x.
+    void Correct(const std::vector<double>& d) {
+        assert(d.size() == x_.size());
+        for (size_t j = 0; j < x_.size(); ++j) x_[j] += d[j];
+    }
+
+    //! Residual of the current x, see Residual(net, x, r).
+    double Residual(thrill::net::FlowControlChannel& net,
+                    std::vector<double>* r = nullptr) {
+        return Residual(net, x_, r);
+    }
+
+    /*!
+     * Computes r = b - A x for the owned rows and returns the local sum of
+     * |r|. x holds K values per owned row; the values of the neighbouring
+     * rows are fetched from the other workers, so this is collective. If r is
+     * nullptr, only the sum is computed.
+     */
+    double Residual(thrill::net::FlowControlChannel& net,
+                    const std::vector<double>& x, std::vector<double>* r) {
+        std::vector<double> send, up, down;
+
+        if (n_ > 0) send.assign(x.end() - k_, x.end());
+        up = net.Predecessor(k_, send);
+        if (n_ > 0) send.assign(x.begin(), x.begin() + k_);
+        down = net.Successor(k_, send);
+        up.resize(k_, 0.0), down.resize(k_, 0.0);
+
+        if (r) r->resize(n_ * k_);
+        double sum = 0;
+        for (size_t i = 0; i < n_; ++i) {
+            const double* above = i > 0 ? &x[(i - 1) * k_] : up.data();
+            const double* below = i + 1 < n_ ? &x[(i + 1) * k_] : down.data();
+            for (size_t k = 0; k < k_; ++k) {
+                double res = b_[i * k_ + k] - ai_[i] * x[i * k_ + k]
+                             - bi_[i] * above[k] - ci_[i] * below[k];
+                if (r) (*r)[i * k_ + k] = res;
+                sum += std::fabs(res);
+            }
+        }
+        return sum;
+    }
+
+    //! x of the owned rows, K values per row
+    const std::vector<double>& Solution() const { return x_; }
+
+private:
+    //! number of right hand sides
+    size_t k_;
+    //! number of owned rows
+    size_t n_;
+
+    //! matrix entries and right hand sides of the owned rows
+    std::vector<double> bi_, ai_, ci_, b_;
+
+    std::vector<double> x_;
+};
+
+} // namespace gabp
+
+#endif // !GABP_REFINEMENT_HEADER
+
+/******************************************************************************/
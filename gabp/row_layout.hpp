@@ -0,0 +1,36 @@
+/*******************************************************************************
+ * gabp/row_layout.hpp
+ *
+ * Column layout of the GaBP input rows: the three nonzeros of a row of the
+ * tridiagonal matrix, the messages, the right hand side and the solution.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_ROW_LAYOUT_HEADER
+#define GABP_ROW_LAYOUT_HEADER
+
+// bi,ai,ci,Pbi,Pai,Pci,Ubi,Uai,Uci,Pi,Ui,b,x
+
+#define BI 0
+#define AI 1
+#define CI 2
+#define PBI 3
+#define PAI 4
+#define PCI 5
+#define UBI 6
+#define UAI 7
+#define UCI 8
+#define PI 9
+#define UI 10
+#define B 11
+#define X 12
+
+//! number of columns of a row. Rows with K right hand sides b_0..b_{K-1}
+//! starting at column B have ROW_SIZE + K - 1 columns, x follows the last b.
+#define ROW_SIZE 13
+
+#endif // !GABP_ROW_LAYOUT_HEADER
+
+/******************************************************************************/
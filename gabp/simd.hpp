@@ -0,0 +1,191 @@
+/*******************************************************************************
+ * gabp/simd.hpp
+ *
+ * Thin wrappers around the SIMD registers used by the GaBP kernels, so that
+ * each kernel is written once and instantiated for AVX-512, AVX2 and plain
+ * scalar code, on doubles or on floats.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_SIMD_HEADER
+#define GABP_SIMD_HEADER
+
+#include <thrill/common/config.hpp>
+
+#if defined(THRILL_HAVE_AVX2) || defined(THRILL_HAVE_AVX512F)
+#include <immintrin.h>
+#endif
+
+#include <cmath>
+#include <cstddef>
+
+namespace gabp {
+
+//! One value per "register", used for the loop tails and as fallback.
+template <typename Real>
+struct BasicSimdScalar {
+    using Reg = Real;
+    static constexpr size_t width = 1;
+
+    static Reg load(const Real* p) { return *p; }
+    static void store(Real* p, Reg a) { *p = a; }
+    static Reg set1(Real v) { return v; }
+    static Reg zero() { return Real(0); }
+    static Reg add(Reg a, Reg b) { return a + b; }
+    static Reg sub(Reg a, Reg b) { return a - b; }
+    static Reg mul(Reg a, Reg b) { return a * b; }
+    static Reg div(Reg a, Reg b) { return a / b; }
+    //! a, with lanes equal to zero replaced by guard
+    static Reg zero_guard(Reg a, Reg guard) { return a == 0 ? guard : a; }
+    static Reg abs(Reg a) { return std::fabs(a); }
+    static Real hsum(Reg a) { return a; }
+};
+
+using SimdScalar = BasicSimdScalar<double>;
+using SimdScalarFloat = BasicSimdScalar<float>;
+
+#if defined(THRILL_HAVE_AVX2)
+//! Four doubles per AVX2 register.
+struct SimdAVX2 {
+    using Reg = __m256d;
+    static constexpr size_t width = 4;
+
+    static Reg load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Reg a) { _mm256_storeu_pd(p, a); }
+    static Reg set1(double v) { return _mm256_set1_pd(v); }
+    static Reg zero() { return _mm256_setzero_pd(); }
+    static Reg add(Reg a, Reg b) { return _mm256_add_pd(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm256_sub_pd(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm256_mul_pd(a, b); }
+    static Reg div(Reg a, Reg b) { return _mm256_div_pd(a, b); }
+    static Reg zero_guard(Reg a, Reg guard) {
+        return _mm256_blendv_pd(
+            a, guard, _mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_EQ_OQ));
+    }
+    static Reg abs(Reg a) {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+    }
+    static double hsum(Reg a) {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a),
+                               _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+};
+
+//! Eight floats per AVX2 register.
+struct SimdAVX2Float {
+    using Reg = __m256;
+    static constexpr size_t width = 8;
+
+    static Reg load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, Reg a) { _mm256_storeu_ps(p, a); }
+    static Reg set1(float v) { return _mm256_set1_ps(v); }
+    static Reg zero() { return _mm256_setzero_ps(); }
+    static Reg add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+    static Reg div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+    static Reg zero_guard(Reg a, Reg guard) {
+        return _mm256_blendv_ps(
+            a, guard, _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    }
+    static Reg abs(Reg a) {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+    }
+    static float hsum(Reg a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a),
+                              _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s)));
+    }
+};
+#endif
+
+#if defined(THRILL_HAVE_AVX512F)
+//! Eight doubles per AVX-512 register.
+struct SimdAVX512 {
+    using Reg = __m512d;
+    static constexpr size_t width = 8;
+
+    static Reg load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, Reg a) { _mm512_storeu_pd(p, a); }
+    static Reg set1(double v) { return _mm512_set1_pd(v); }
+    static Reg zero() { return _mm512_setzero_pd(); }
+    static Reg add(Reg a, Reg b) { return _mm512_add_pd(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm512_sub_pd(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm512_mul_pd(a, b); }
+    static Reg div(Reg a, Reg b) { return _mm512_div_pd(a, b); }
+    static Reg zero_guard(Reg a, Reg guard) {
+        return _mm512_mask_blend_pd(
+            _mm512_cmp_pd_mask(a, _mm512_setzero_pd(), _CMP_EQ_OQ), a, guard);
+    }
+    static Reg abs(Reg a) {
+        return _mm512_castsi512_pd(_mm512_andnot_si512(
+                                       _mm512_castpd_si512(_mm512_set1_pd(-0.0)),
+                                       _mm512_castpd_si512(a)));
+    }
+    static double hsum(Reg a) { return _mm512_reduce_add_pd(a); }
+};
+
+//! Sixteen floats per AVX-512 register.
+struct SimdAVX512Float {
+    using Reg = __m512;
+    static constexpr size_t width = 16;
+
+    static Reg load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, Reg a) { _mm512_storeu_ps(p, a); }
+    static Reg set1(float v) { return _mm512_set1_ps(v); }
+    static Reg zero() { return _mm512_setzero_ps(); }
+    static Reg add(Reg a, Reg b) { return _mm512_add_ps(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm512_sub_ps(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm512_mul_ps(a, b); }
+    static Reg div(Reg a, Reg b) { return _mm512_div_ps(a, b); }
+    static Reg zero_guard(Reg a, Reg guard) {
+        return _mm512_mask_blend_ps(
+            _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_EQ_OQ), a, guard);
+    }
+    static Reg abs(Reg a) {
+        return _mm512_castsi512_ps(_mm512_andnot_si512(
+                                       _mm512_castps_si512(_mm512_set1_ps(-0.0f)),
+                                       _mm512_castps_si512(a)));
+    }
+    static float hsum(Reg a) { return _mm512_reduce_add_ps(a); }
+};
+#endif
+
+//! widest register type of the target
+#if defined(THRILL_HAVE_AVX512F)
+using SimdNative = SimdAVX512;
+using SimdNativeFloat = SimdAVX512Float;
+#elif defined(THRILL_HAVE_AVX2)
+using SimdNative = SimdAVX2;
+using SimdNativeFloat = SimdAVX2Float;
+#else
+using SimdNative = SimdScalar;
+using SimdNativeFloat = SimdScalarFloat;
+#endif
+
+//! The register types for values of type Real: Native is the widest one of
+//! the target, Scalar handles the remaining values.
+template <typename Real>
+struct SimdFor;
+
+template <>
+struct SimdFor<double> {
+    using Native = SimdNative;
+    using Scalar = SimdScalar;
+};
+
+template <>
+struct SimdFor<float> {
+    using Native = SimdNativeFloat;
+    using Scalar = SimdScalarFloat;
+};
+
+} // namespace gabp
+
+#endif // !GABP_SIMD_HEADER
+
+/******************************************************************************/
@@ -0,0 +1,747 @@
+/*******************************************************************************
+ * gabp/soa_engine.hpp
+ *
+ * GaBP engine for tridiagonal systems, which keeps the local rows in
+ * structure-of-arrays layout and runs a vectorized Jacobi sweep on them.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_SOA_ENGINE_HEADER
+#define GABP_SOA_ENGINE_HEADER
+
+#include "simd.hpp"
+
+#include <thrill/net/flow_control_channel.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// after all other headers, the column names are plain macros
+#include "row_layout.hpp"
+
+namespace gabp {
+
+//! replaces zero denominators, as in the sweep of GaBP.cpp
+constexpr double kZeroGuard = 0.00001;
+
+/*!
+ * The engine takes the buffer of an InterMap2D(ROW_SIZE, 1, 1) call: the first
+ * and the last row are the halo rows of the neighbouring workers (or the
+ * all-zero sentinel rows at both ends of the matrix), the rows in between are
+ * owned by this worker.
+ *
+ * Each field of the owned rows is stored in its own contiguous array. The
+ * message arrays have one halo slot in front and one at the back, slot i+1
+ * belongs to owned row i. A sweep reads the messages of the last iteration and
+ * writes the new ones into a second set of arrays (Jacobi), so that all rows
+ * can be processed independently by the SIMD kernels. Couplings which are zero
+ * are handled with 0/1 masks instead of branches. Each kernel is instantiated
+ * for the widest register type of the target and for the scalar one, which
+ * handles the remaining rows.
+ *
+ * The messages, x and the matrix entries are of type Real. With float, a
+ * register holds twice as many rows and the halo packets are half as large,
+ * residuals are still summed up in double. The input rows are always double.
+ *
+ * As the precision messages do not depend on the right hand side, they can
+ * also be iterated on their own with RunPrecisions(). Afterwards they are
+ * frozen and RunMeans() iterates only the linear mean update, which needs
+ * half of the halo values and about half of the flops of a full sweep.
+ *
+ * A row may carry K right hand sides b_0..b_{K-1} starting at column B, x then
+ * follows them at column B+K. The mean messages, b and x are stored row-major
+ * with K consecutive values per row, so that the mean sweep vectorizes across
+ * the right hand sides and all K halo values of a row go out in one packet.
+ * With K > 1 only the two-phase mode is available, the precisions are shared
+ * by all right hand sides.
+ *
+ * RunActive() is a residual scheduled variant of Run(): only the rows in an
+ * active set are recomputed. A row whose messages change by more than a
+ * threshold activates its two neighbours for the next sweep, a changed halo
+ * activates the boundary row. As the active rows are scattered, this sweep is
+ * scalar. Activity spreads by at most one row per sweep, so when no active row
+ * lies within D rows of any worker boundary, the next D halo exchanges cannot
+ * carry anything new and are skipped by all workers.
+ *
+ * For inputs on which the plain updates oscillate, each new message can be
+ * damped with the old one (SetDamping()), and Run() and RunMeans() can
+ * extrapolate the messages with Aitken's delta-squared method every few
+ * sweeps (SetExtrapolation()).
+ */
+template <typename Real>
+class SoAEngine
+{
+public:
+    SoAEngine(const std::vector<double>& values, size_t row_size,
+              size_t num_rhs = 1)
+        : k_(num_rhs) {
+        size_t rows = values.size() / row_size;
+        n_ = rows >= 2 ? rows - 2 : 0;
+
+        bi_.resize(n_), ai_.resize(n_), ci_.resize(n_);
+        mask_b_.resize(n_), mask_c_.resize(n_);
+        inv_bi_.resize(n_), inv_ci_.resize(n_);
+        b_.resize(n_ * k_);
+        x_.assign(n_ * k_, 0.0);
+        for (std::vector<Real>* m : { &pbi_, &pci_, &pbi_next_, &pci_next_ })
+            m->assign(n_ + 2, 0.0);
+        for (std::vector<Real>* m : { &ubi_, &uci_, &ubi_next_, &uci_next_ })
+            m->assign((n_ + 2) * k_, 0.0);
+
+        for (size_t i = 0; i < n_; ++i) {
+            const double* row = values.data() + (i + 1) * row_size;
+            bi_[i] = row[BI], ai_[i] = row[AI], ci_[i] = row[CI];
+            mask_b_[i] = row[BI] != 0 ? 1.0 : 0.0;
+            mask_c_[i] = row[CI] != 0 ? 1.0 : 0.0;
+            inv_bi_[i] = row[BI] != 0 ? 1.0 / row[BI] : 0.0;
+            inv_ci_[i] = row[CI] != 0 ? 1.0 / row[CI] : 0.0;
+            pbi_[i + 1] = row[PBI], pci_[i + 1] = row[PCI];
+            for (size_t k = 0; k < k_; ++k) {
+                b_[i * k_ + k] = row[B + k];
+                // the input rows have one initial mean message for all b
+                ubi_[(i + 1) * k_ + k] = row[UBI];
+                uci_[(i + 1) * k_ + k] = row[UCI];
+            }
+        }
+        if (n_ > 0) {
+            const double* up = values.data();
+            const double* down = values.data() + (n_ + 1) * row_size;
+            pci_[0] = up[PCI], pbi_[n_ + 1] = down[PBI];
+            for (size_t k = 0; k < k_; ++k) {
+                uci_[k] = up[UCI];
+                ubi_[(n_ + 1) * k_ + k] = down[UBI];
+            }
+        }
+    }
+
+    //! number of rows owned by this worker
+    size_t size() const { return n_; }
+
+    //! number of right hand sides
+    size_t num_rhs() const { return k_; }
+
+    //! Each new message becomes (1 - damping) * new + damping * old, 0
+    //! disables damping.
+    void SetDamping(double damping) { damping_ = Real(damping); }
+
+    //! Extrapolates the messages with Aitken's delta-squared method every
+    //! interval sweeps of Run() and RunMeans(), 0 disables it. The interval
+    //! must be at least 3.
+    void SetExtrapolation(size_t interval) {
+        assert(interval == 0 || interval >= 3);
+        aitken_interval_ = interval;
+    }
+
+    /*!
+     * Runs up to max_iterations sweeps. Every check_interval sweeps the
+     * residuals are summed up over all workers and passed to
+     * converged(residual, iteration), all workers stop together once it
+     * returns true. Returns the number of sweeps done.
+     */
+    template <typename ConvergedFunction>
+    size_t Run(thrill::net::FlowControlChannel& net, size_t max_iterations,
+               size_t check_interval, const ConvergedFunction& converged) {
+        assert(k_ == 1);
+        ResetExtrapolation();
+        size_t iter = Iterate(
+            net, max_iterations, check_interval, converged,
+            [this, &net]() {
+                ExchangeHalos(net, { &pci_, &uci_ }, { &pbi_, &ubi_ });
+                double residual = Sweep();
+                Extrapolate({ &pbi_, &ubi_, &pci_, &uci_ }, 1);
+                return residual;
+            });
+        UpdateSolution(net);
+        return iter;
+    }
+
+    /*!
+     * First phase of the two-phase mode: iterates only the precision messages
+     * until converged(residual, iteration) holds for their summed change, then
+     * freezes them.
+     */
+    template <typename ConvergedFunction>
+    size_t RunPrecisions(thrill::net::FlowControlChannel& net,
+                         size_t max_iterations, size_t check_interval,
+                         const ConvergedFunction& converged) {
+        size_t iter = Iterate(
+            net, max_iterations, check_interval, converged,
+            [this, &net]() {
+                ExchangeHalos(net, { &pci_ }, { &pbi_ });
+                return SweepPrecisions();
+            });
+        // the frozen values need the final precisions of the neighbours
+        ExchangeHalos(net, { &pci_ }, { &pbi_ });
+        FreezePrecisions();
+        return iter;
+    }
+
+    //! Second phase of the two-phase mode: iterates only the mean messages
+    //! with the precisions frozen by RunPrecisions().
+    template <typename ConvergedFunction>
+    size_t RunMeans(thrill::net::FlowControlChannel& net, size_t max_iterations,
+                    size_t check_interval, const ConvergedFunction& converged) {
+        assert(frozen_);
+        ResetExtrapolation();
+        size_t iter = Iterate(
+            net, max_iterations, check_interval, converged,
+            [this, &net]() {
+                ExchangeHalos(net, { &uci_ }, { &ubi_ }, k_);
+                double residual = SweepMeans();
+                Extrapolate({ &ubi_, &uci_ }, k_);
+                return residual;
+            });
+        UpdateSolution(net);
+        return iter;
+    }
+
+    /*!
+     * Runs up to max_iterations sweeps over the active rows only, rows whose
+     * messages change by at most threshold in a sweep drop out of the set.
+     * Every check_interval sweeps converged(residual, active_rows, iteration)
+     * is called with the values summed over all workers, and the number of
+     * halo exchanges which can be skipped is determined. Returns the number of
+     * sweeps done.
+     */
+    template <typename ConvergedFunction>
+    size_t RunActive(thrill::net::FlowControlChannel& net,
+                     size_t max_iterations, size_t check_interval,
+                     double threshold, const ConvergedFunction& converged) {
+        assert(k_ == 1);
+        ResetExtrapolation();
+        pending_flag_.assign(n_, 0);
+        pending_.clear();
+        for (size_t i = 0; i < n_; ++i) Activate(i);
+
+        size_t iter = 0, skip = 0;
+        while (iter < max_iterations) {
+            if (skip > 0)
+                --skip;
+            else
+                ExchangeActiveHalos(net, threshold);
+
+            double residual = SweepActive(threshold);
+            ++iter;
+
+            if (check_interval != 0 && iter % check_interval == 0) {
+                std::array<double, 3> local = {
+                    { residual, double(pending_.size()), double(QuietDistance()) }
+                };
+                std::array<double, 3> global = net.AllReduce(
+                    local, [](const std::array<double, 3>& a,
+                              const std::array<double, 3>& b) {
+                        return std::array<double, 3>{
+                            { a[0] + b[0], a[1] + b[1], std::min(a[2], b[2]) }
+                        };
+                    });
+                if (converged(global[0], size_t(global[1]), iter)) break;
+                skip = size_t(std::min(global[2], double(check_interval)));
+            }
+        }
+        UpdateSolution(net);
+        return iter;
+    }
+
+    /*!
+     * Fetches the incoming messages of the neighbouring workers' boundary
+     * rows: the values of down_fields of the predecessor's last row and those
+     * of up_fields of the successor's first row, count values per field and
+     * row. Workers without owned rows forward the ones of their neighbours.
+     */
+    void ExchangeHalos(thrill::net::FlowControlChannel& net,
+                       std::initializer_list<std::vector<Real>*> down_fields,
+                       std::initializer_list<std::vector<Real>*> up_fields,
+                       size_t count = 1) {
+        std::vector<Real> send, recv;
+
+        if (n_ > 0) {
+            for (std::vector<Real>* f : down_fields)
+                send.insert(send.end(), f->begin() + n_ * count,
+                            f->begin() + (n_ + 1) * count);
+        }
+        recv = net.Predecessor(down_fields.size() * count, send);
+        if (recv.size() == down_fields.size() * count) {
+            auto it = recv.begin();
+            for (std::vector<Real>* f : down_fields) {
+                std::copy(it, it + count, f->begin());
+                it += count;
+            }
+        }
+
+        send.clear();
+        if (n_ > 0) {
+            for (std::vector<Real>* f : up_fields)
+                send.insert(send.end(), f->begin() + count,
+                            f->begin() + 2 * count);
+        }
+        recv = net.Successor(up_fields.size() * count, send);
+        if (recv.size() == up_fields.size() * count) {
+            auto it = recv.begin();
+            for (std::vector<Real>* f : up_fields) {
+                std::copy(it, it + count, f->begin() + (n_ + 1) * count);
+                it += count;
+            }
+        }
+    }
+
+    //! One Jacobi sweep over all owned rows, returns the summed change of x.
+    double Sweep() {
+        size_t i = 0;
+        double residual = SweepKernel<Native>(i);
+        residual += SweepKernel<Scalar>(i);
+
+        Damp(pbi_next_, pbi_, 1), Damp(ubi_next_, ubi_, 1);
+        Damp(pci_next_, pci_, 1), Damp(uci_next_, uci_, 1);
+        std::swap(pbi_, pbi_next_), std::swap(ubi_, ubi_next_);
+        std::swap(pci_, pci_next_), std::swap(uci_, uci_next_);
+        return residual;
+    }
+
+    //! Sweep over the precision messages only, returns their summed change.
+    double SweepPrecisions() {
+        size_t i = 0;
+        double residual = SweepPrecisionsKernel<Native>(i);
+        residual += SweepPrecisionsKernel<Scalar>(i);
+
+        Damp(pbi_next_, pbi_, 1), Damp(pci_next_, pci_, 1);
+        std::swap(pbi_, pbi_next_), std::swap(pci_, pci_next_);
+        return residual;
+    }
+
+    //! Stores the incoming precisions and 1/P of each row for RunMeans().
+    void FreezePrecisions() {
+        in_c_.resize(n_), in_b_.resize(n_), inv_p_.resize(n_);
+        for (size_t i = 0; i < n_; ++i) {
+            in_c_[i] = mask_b_[i] * pci_[i];
+            in_b_[i] = mask_c_[i] * pbi_[i + 2];
+            Real p = ai_[i] + in_c_[i] + in_b_[i];
+            inv_p_[i] = Real(1) / (p == 0 ? Real(kZeroGuard) : p);
+        }
+        frozen_ = true;
+    }
+
+    //! Sweep over the mean messages with frozen precisions, returns the
+    //! summed change of x over all right hand sides.
+    double SweepMeans() {
+        double residual = 0;
+        if (k_ == 1) {
+            size_t i = 0;
+            residual += SweepMeansKernel<Native>(i);
+            residual += SweepMeansKernel<Scalar>(i);
+        }
+        else {
+            for (size_t i = 0; i < n_; ++i) {
+                size_t k = 0;
+                residual += SweepMeansRowKernel<Native>(i, k);
+                residual += SweepMeansRowKernel<Scalar>(i, k);
+            }
+        }
+
+        Damp(ubi_next_, ubi_, k_), Damp(uci_next_, uci_, k_);
+        std::swap(ubi_, ubi_next_), std::swap(uci_, uci_next_);
+        return residual;
+    }
+
+    //! Sweep over the active rows, returns the summed change of x. The rows
+    //! for the next sweep are collected in pending_.
+    double SweepActive(double threshold) {
+        active_.swap(pending_);
+        pending_.clear();
+        for (size_t i : active_) pending_flag_[i] = 0;
+        std::sort(active_.begin(), active_.end());
+
+        const Real guard = Real(kZeroGuard);
+        double residual = 0;
+        changed_.clear();
+        for (size_t i : active_) {
+            Real a = ai_[i], b = b_[i];
+            Real hc = mask_b_[i] * pci_[i], hcu = hc * uci_[i];
+            Real hb = mask_c_[i] * pbi_[i + 2], hbu = hb * ubi_[i + 2];
+
+            Real p = a + hc + hb;
+            Real x = (b + hcu + hbu) / (p == 0 ? guard : p);
+            residual += std::fabs(x - x_[i]);
+            x_[i] = x;
+
+            Real db = a + hb, dc = a + hc;
+            pbi_next_[i + 1] = -bi_[i] * bi_[i] / (db == 0 ? guard : db);
+            ubi_next_[i + 1] = (b + hbu) * inv_bi_[i];
+            pci_next_[i + 1] = -ci_[i] * ci_[i] / (dc == 0 ? guard : dc);
+            uci_next_[i + 1] = (b + hcu) * inv_ci_[i];
+
+            Real delta =
+                std::fabs(pbi_next_[i + 1] - pbi_[i + 1]) +
+                std::fabs(ubi_next_[i + 1] - ubi_[i + 1]) +
+                std::fabs(pci_next_[i + 1] - pci_[i + 1]) +
+                std::fabs(uci_next_[i + 1] - uci_[i + 1]);
+            if (delta > threshold) changed_.push_back(i);
+        }
+
+        // all rows read the messages of the last sweep, commit them now
+        const Real keep = Real(1) - damping_;
+        for (size_t i : active_) {
+            for (std::vector<Real>* m : { &pbi_, &ubi_, &pci_, &uci_ }) {
+                std::vector<Real>& next = NextOf(m);
+                (*m)[i + 1] = keep * next[i + 1] + damping_ * (*m)[i + 1];
+            }
+        }
+        if (!active_.empty() &&
+            (active_.front() == 0 || active_.back() == n_ - 1))
+            boundary_dirty_ = true;
+
+        // a damped row only moved part of the way, so it stays active too
+        for (size_t i : changed_) {
+            if (damping_ > 0) Activate(i);
+            if (i > 0) Activate(i - 1);
+            if (i + 1 < n_) Activate(i + 1);
+        }
+        return residual;
+    }
+
+    /*!
+     * Replaces the right hand sides by r, K values per row, and restarts the
+     * mean messages from zero. The precision messages do not depend on b and
+     * are kept, which makes this cheap for the correction solves of iterative
+     * refinement.
+     */
+    void SetRhs(const std::vector<double>& r) {
+        assert(r.size() == n_ * k_);
+        std::copy(r.begin(), r.end(), b_.begin());
+        for (std::vector<Real>* m : { &ubi_, &uci_, &ubi_next_, &uci_next_ })
+            std::fill(m->begin(), m->end(), Real(0));
+        std::fill(x_.begin(), x_.end(), Real(0));
+        ResetExtrapolation();
+    }
+
+    //! whether RunPrecisions() has frozen the precisions, they are kept by
+    //! SetRhs() and only RunMeans() is needed for a new right hand side
+    bool frozen() const { return frozen_; }
+
+    //! x of the owned rows from the final messages of the last run, K values
+    //! per row
+    std::vector<double> Solution() const {
+        return std::vector<double>(x_.begin(), x_.end());
+    }
+
+private:
+    //! register types for the kernels
+    using Native = typename SimdFor<Real>::Native;
+    using Scalar = typename SimdFor<Real>::Scalar;
+
+    //! number of right hand sides
+    size_t k_;
+    //! number of owned rows
+    size_t n_;
+
+    //! matrix entries of the owned rows
+    std::vector<Real> bi_, ai_, ci_;
+    //! right hand sides, K per row
+    std::vector<Real> b_;
+    //! 1.0 where the row is coupled to its upper/lower neighbour, else 0.0
+    std::vector<Real> mask_b_, mask_c_;
+    //! 1/bi and 1/ci, 0.0 where there is no coupling
+    std::vector<Real> inv_bi_, inv_ci_;
+
+    //! messages of the last sweep, with halo slots, the mean messages with K
+    //! values per row
+    std::vector<Real> pbi_, ubi_, pci_, uci_;
+    //! messages written by the current sweep
+    std::vector<Real> pbi_next_, ubi_next_, pci_next_, uci_next_;
+
+    //! frozen incoming precisions from above/below and 1/P of the rows
+    std::vector<Real> in_c_, in_b_, inv_p_;
+    bool frozen_ = false;
+
+    std::vector<Real> x_;
+
+    //! weight of the old value in each message update
+    Real damping_ = 0;
+    //! sweeps between two extrapolations, 0 for none
+    size_t aitken_interval_ = 0;
+    //! sweeps of the current Run() or RunMeans(), for the extrapolation
+    size_t aitken_sweeps_ = 0;
+    //! messages of the two sweeps before an extrapolation
+    std::vector<std::vector<Real> > aitken_m0_, aitken_m1_;
+
+    //! rows of the current sweep of RunActive(), sorted, and the rows whose
+    //! messages changed in it
+    std::vector<size_t> active_, changed_;
+    //! rows of the next sweep and a flag per row whether it is in there
+    std::vector<size_t> pending_;
+    std::vector<unsigned char> pending_flag_;
+    //! the first or the last row was recomputed since the last exchange
+    bool boundary_dirty_ = false;
+
+    //! The array the current sweep writes the new values of m into.
+    std::vector<Real>& NextOf(std::vector<Real>* m) {
+        if (m == &pbi_) return pbi_next_;
+        if (m == &ubi_) return ubi_next_;
+        if (m == &pci_) return pci_next_;
+        return uci_next_;
+    }
+
+    //! Mixes the old messages of the owned rows into the new ones, count
+    //! values per row.
+    void Damp(std::vector<Real>& next, const std::vector<Real>& old,
+              size_t count) {
+        if (damping_ == 0) return;
+        const Real keep = Real(1) - damping_;
+        for (size_t j = count; j < (n_ + 1) * count; ++j)
+            next[j] = keep * next[j] + damping_ * old[j];
+    }
+
+    /*!
+     * Called after each sweep of Run() and RunMeans(). Keeps the messages of
+     * the owned rows of the two sweeps before each aitken_interval_-th one and
+     * then replaces each message m2 with Aitken's extrapolation of the
+     * sequence m0, m1, m2, m2 - (m2 - m1)^2 / ((m2 - m1) - (m1 - m0)). This is
+     * only done where the steps shrink, elsewhere the message is kept.
+     */
+    void Extrapolate(std::initializer_list<std::vector<Real>*> fields,
+                     size_t count) {
+        if (aitken_interval_ == 0) return;
+        size_t phase = ++aitken_sweeps_ % aitken_interval_;
+        size_t begin = count, end = (n_ + 1) * count;
+
+        if (phase == aitken_interval_ - 2 || phase == aitken_interval_ - 1) {
+            std::vector<std::vector<Real> >& h =
+                phase == aitken_interval_ - 2 ? aitken_m0_ : aitken_m1_;
+            h.resize(fields.size());
+            size_t f = 0;
+            for (std::vector<Real>* m : fields)
+                h[f++].assign(m->begin() + begin, m->begin() + end);
+            return;
+        }
+        if (phase != 0 || aitken_m1_.size() != fields.size()) return;
+
+        size_t f = 0;
+        for (std::vector<Real>* m : fields) {
+            const std::vector<Real>& m0 = aitken_m0_[f], & m1 = aitken_m1_[f];
+            ++f;
+            for (size_t j = 0; j < end - begin; ++j) {
+                Real& m2 = (*m)[begin + j];
+                Real d1 = m1[j] - m0[j], d2 = m2 - m1[j], den = d2 - d1;
+                if (den != 0 && std::fabs(d2) < std::fabs(d1))
+                    m2 -= d2 * d2 / den;
+            }
+        }
+    }
+
+    //! Drops the messages kept for the extrapolation, which belong to an
+    //! earlier run or right hand side.
+    void ResetExtrapolation() {
+        aitken_sweeps_ = 0;
+        aitken_m0_.clear();
+        aitken_m1_.clear();
+    }
+
+    //! Recomputes x from the final messages, as GaBPSolution() in GaBP.cpp
+    //! does. A sweep computes x from the messages it reads, which leaves it
+    //! one sweep behind the messages it writes.
+    void UpdateSolution(thrill::net::FlowControlChannel& net) {
+        if (frozen_)
+            ExchangeHalos(net, { &uci_ }, { &ubi_ }, k_);
+        else
+            ExchangeHalos(net, { &pci_, &uci_ }, { &pbi_, &ubi_ });
+
+        const Real guard = Real(kZeroGuard);
+        for (size_t i = 0; i < n_; ++i) {
+            Real hc = mask_b_[i] * pci_[i], hb = mask_c_[i] * pbi_[i + 2];
+            Real p = ai_[i] + hc + hb;
+            if (p == 0) p = guard;
+            for (size_t k = 0; k < k_; ++k) {
+                x_[i * k_ + k] = (b_[i * k_ + k] + hc * uci_[i * k_ + k] +
+                                  hb * ubi_[(i + 2) * k_ + k]) / p;
+            }
+        }
+    }
+
+    //! Adds row i to the rows of the next active sweep.
+    void Activate(size_t i) {
+        if (pending_flag_[i]) return;
+        pending_flag_[i] = 1;
+        pending_.push_back(i);
+    }
+
+    //! Halo exchange of RunActive(), activates the boundary rows whose
+    //! incoming messages changed by more than threshold.
+    void ExchangeActiveHalos(thrill::net::FlowControlChannel& net,
+                             double threshold) {
+        Real up_p = pci_[0], up_u = uci_[0];
+        Real down_p = pbi_[n_ + 1], down_u = ubi_[n_ + 1];
+
+        ExchangeHalos(net, { &pci_, &uci_ }, { &pbi_, &ubi_ });
+        boundary_dirty_ = false;
+        if (n_ == 0) return;
+
+        if (std::fabs(pci_[0] - up_p) + std::fabs(uci_[0] - up_u) > threshold)
+            Activate(0);
+        if (std::fabs(pbi_[n_ + 1] - down_p) +
+            std::fabs(ubi_[n_ + 1] - down_u) > threshold)
+            Activate(n_ - 1);
+    }
+
+    //! Number of halo exchanges which can be skipped as far as this worker is
+    //! concerned: the distance of the next active row to a boundary.
+    size_t QuietDistance() const {
+        if (n_ == 0) return std::numeric_limits<size_t>::max();
+        if (boundary_dirty_) return 0;
+        if (pending_.empty()) return std::numeric_limits<size_t>::max();
+        size_t lo = *std::min_element(pending_.begin(), pending_.end());
+        size_t hi = *std::max_element(pending_.begin(), pending_.end());
+        return std::min(lo, n_ - 1 - hi);
+    }
+
+    //! Common loop of Run(), RunPrecisions() and RunMeans().
+    template <typename ConvergedFunction, typename StepFunction>
+    size_t Iterate(thrill::net::FlowControlChannel& net, size_t max_iterations,
+                   size_t check_interval, const ConvergedFunction& converged,
+                   const StepFunction& step) {
+        size_t iter = 0;
+        while (iter < max_iterations) {
+            double residual = step();
+            ++iter;
+
+            if (check_interval != 0 && iter % check_interval == 0) {
+                double global_residual = net.AllReduce(residual);
+                if (converged(global_residual, iter)) break;
+            }
+        }
+        return iter;
+    }
+
+    //! Kernel of Sweep(), processes rows from i on in steps of S::width as
+    //! long as whole registers fit and advances i.
+    template <typename S>
+    double SweepKernel(size_t& i) {
+        using Reg = typename S::Reg;
+        const Reg zero = S::zero();
+        const Reg guard = S::set1(kZeroGuard);
+        Reg res = zero;
+
+        for ( ; i + S::width <= n_; i += S::width) {
+            Reg a = S::load(&ai_[i]);
+            Reg b = S::load(&b_[i]);
+
+            // incoming precision and weighted mean from the rows above and below
+            Reg hc = S::mul(S::load(&mask_b_[i]), S::load(&pci_[i]));
+            Reg hcu = S::mul(hc, S::load(&uci_[i]));
+            Reg hb = S::mul(S::load(&mask_c_[i]), S::load(&pbi_[i + 2]));
+            Reg hbu = S::mul(hb, S::load(&ubi_[i + 2]));
+
+            Reg p = S::zero_guard(S::add(S::add(a, hc), hb), guard);
+            Reg x = S::div(S::add(S::add(b, hcu), hbu), p);
+            res = S::add(res, S::abs(S::sub(x, S::load(&x_[i]))));
+            S::store(&x_[i], x);
+
+            Reg bi = S::load(&bi_[i]);
+            Reg db = S::zero_guard(S::add(a, hb), guard);
+            S::store(&pbi_next_[i + 1], S::div(S::sub(zero, S::mul(bi, bi)), db));
+            S::store(&ubi_next_[i + 1],
+                     S::mul(S::add(b, hbu), S::load(&inv_bi_[i])));
+
+            Reg ci = S::load(&ci_[i]);
+            Reg dc = S::zero_guard(S::add(a, hc), guard);
+            S::store(&pci_next_[i + 1], S::div(S::sub(zero, S::mul(ci, ci)), dc));
+            S::store(&uci_next_[i + 1],
+                     S::mul(S::add(b, hcu), S::load(&inv_ci_[i])));
+        }
+        return S::hsum(res);
+    }
+
+    //! Kernel of SweepPrecisions().
+    template <typename S>
+    double SweepPrecisionsKernel(size_t& i) {
+        using Reg = typename S::Reg;
+        const Reg zero = S::zero();
+        const Reg guard = S::set1(kZeroGuard);
+        Reg res = zero;
+
+        for ( ; i + S::width <= n_; i += S::width) {
+            Reg a = S::load(&ai_[i]);
+            Reg hc = S::mul(S::load(&mask_b_[i]), S::load(&pci_[i]));
+            Reg hb = S::mul(S::load(&mask_c_[i]), S::load(&pbi_[i + 2]));
+
+            Reg bi = S::load(&bi_[i]);
+            Reg db = S::zero_guard(S::add(a, hb), guard);
+            Reg pbi = S::div(S::sub(zero, S::mul(bi, bi)), db);
+
+            Reg ci = S::load(&ci_[i]);
+            Reg dc = S::zero_guard(S::add(a, hc), guard);
+            Reg pci = S::div(S::sub(zero, S::mul(ci, ci)), dc);
+
+            res = S::add(res, S::abs(S::sub(pbi, S::load(&pbi_[i + 1]))));
+            res = S::add(res, S::abs(S::sub(pci, S::load(&pci_[i + 1]))));
+            S::store(&pbi_next_[i + 1], pbi);
+            S::store(&pci_next_[i + 1], pci);
+        }
+        return S::hsum(res);
+    }
+
+    //! Kernel of SweepMeans().
+    template <typename S>
+    double SweepMeansKernel(size_t& i) {
+        using Reg = typename S::Reg;
+        Reg res = S::zero();
+
+        for ( ; i + S::width <= n_; i += S::width) {
+            Reg b = S::load(&b_[i]);
+            Reg sc = S::mul(S::load(&in_c_[i]), S::load(&uci_[i]));
+            Reg sb = S::mul(S::load(&in_b_[i]), S::load(&ubi_[i + 2]));
+
+            Reg x = S::mul(S::add(S::add(b, sc), sb), S::load(&inv_p_[i]));
+            res = S::add(res, S::abs(S::sub(x, S::load(&x_[i]))));
+            S::store(&x_[i], x);
+
+            S::store(&ubi_next_[i + 1],
+                     S::mul(S::add(b, sb), S::load(&inv_bi_[i])));
+            S::store(&uci_next_[i + 1],
+                     S::mul(S::add(b, sc), S::load(&inv_ci_[i])));
+        }
+        return S::hsum(res);
+    }
+
+    //! Kernel of SweepMeans() with K > 1, processes the right hand sides from
+    //! k on of row i.
+    template <typename S>
+    double SweepMeansRowKernel(size_t i, size_t& k) {
+        using Reg = typename S::Reg;
+        Reg res = S::zero();
+
+        const Reg in_c = S::set1(in_c_[i]), in_b = S::set1(in_b_[i]);
+        const Reg inv_p = S::set1(inv_p_[i]);
+        const Reg inv_bi = S::set1(inv_bi_[i]), inv_ci = S::set1(inv_ci_[i]);
+
+        // row i-1 is in slot i, row i+1 in slot i+2
+        const Real* uci = &uci_[i * k_];
+        const Real* ubi = &ubi_[(i + 2) * k_];
+
+        for ( ; k + S::width <= k_; k += S::width) {
+            Reg b = S::load(&b_[i * k_ + k]);
+            Reg sc = S::mul(in_c, S::load(uci + k));
+            Reg sb = S::mul(in_b, S::load(ubi + k));
+
+            Reg x = S::mul(S::add(S::add(b, sc), sb), inv_p);
+            res = S::add(res, S::abs(S::sub(x, S::load(&x_[i * k_ + k]))));
+            S::store(&x_[i * k_ + k], x);
+
+            S::store(&ubi_next_[(i + 1) * k_ + k], S::mul(S::add(b, sb), inv_bi));
+            S::store(&uci_next_[(i + 1) * k_ + k], S::mul(S::add(b, sc), inv_ci));
+        }
+        return S::hsum(res);
+    }
+};
+
+} // namespace gabp
+
+#endif // !GABP_SOA_ENGINE_HEADER
+
+/******************************************************************************/
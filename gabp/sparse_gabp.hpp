@@ -0,0 +1,193 @@
+/*******************************************************************************
+ * gabp/sparse_gabp.hpp
+ *
+ * GaBP for general sparse symmetric systems given row by row in CSR form, run
+ * on the InterMapGraph operator.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_SPARSE_GABP_HEADER
+#define GABP_SPARSE_GABP_HEADER
+
+#include <thrill/api/inter_map_graph.hpp>
+#include <thrill/data/serialization.hpp>
+
+#include <tlx/string/split_view.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gabp {
+
+/*!
+ * One row of a sparse matrix with the GaBP state of its vertex: the diagonal
+ * entry, the off-diagonal entries, and per entry the message from the
+ * neighbour into this row and the message from this row to the neighbour, as
+ * precision P and precision-weighted mean h.
+ *
+ * The messages are kept on both ends of an edge. Both ends compute them from
+ * the same published beliefs, so the copies agree without sending messages;
+ * the vertices only publish their beliefs (P, h).
+ */
+struct SparseRow {
+    size_t id = 0;
+    double b = 0, diag = 0;
+    std::vector<size_t> cols;
+    std::vector<double> vals;
+    //! message from cols[k] into this row
+    std::vector<double> in_p, in_h;
+    //! message from this row to cols[k]
+    std::vector<double> out_p, out_h;
+    //! belief of the vertex and its mean
+    double p = 0, h = 0, x = 0;
+
+    static constexpr bool thrill_is_fixed_size = false;
+    static constexpr size_t thrill_fixed_size = 0;
+
+    template <typename Archive>
+    void ThrillSerialize(Archive& ar) const {
+        using Sizes = thrill::data::Serialization<Archive, std::vector<size_t> >;
+        using Doubles = thrill::data::Serialization<Archive, std::vector<double> >;
+        ar.template PutRaw<size_t>(id);
+        ar.template PutRaw<double>(b);
+        ar.template PutRaw<double>(diag);
+        Sizes::Serialize(cols, ar);
+        Doubles::Serialize(vals, ar);
+        Doubles::Serialize(in_p, ar);
+        Doubles::Serialize(in_h, ar);
+        Doubles::Serialize(out_p, ar);
+        Doubles::Serialize(out_h, ar);
+        ar.template PutRaw<double>(p);
+        ar.template PutRaw<double>(h);
+        ar.template PutRaw<double>(x);
+    }
+
+    template <typename Archive>
+    static SparseRow ThrillDeserialize(Archive& ar) {
+        using Sizes = thrill::data::Serialization<Archive, std::vector<size_t> >;
+        using Doubles = thrill::data::Serialization<Archive, std::vector<double> >;
+        SparseRow r;
+        r.id = ar.template GetRaw<size_t>();
+        r.b = ar.template GetRaw<double>();
+        r.diag = ar.template GetRaw<double>();
+        r.cols = Sizes::Deserialize(ar);
+        r.vals = Doubles::Deserialize(ar);
+        r.in_p = Doubles::Deserialize(ar);
+        r.in_h = Doubles::Deserialize(ar);
+        r.out_p = Doubles::Deserialize(ar);
+        r.out_h = Doubles::Deserialize(ar);
+        r.p = ar.template GetRaw<double>();
+        r.h = ar.template GetRaw<double>();
+        r.x = ar.template GetRaw<double>();
+        return r;
+    }
+};
+
+/*!
+ * Parses a row "i b j_1 a_1 j_2 a_2 ...": the row index, the right hand side
+ * and the nonzeros of the row as column and value pairs. The diagonal entry is
+ * the one with j == i. Repeated columns are summed up into one edge here, like
+ * the diagonal, as the GaBP messages are not linear in the entry and parallel
+ * edges would lead to a wrong fixed point. The columns end up sorted. All
+ * messages start at zero, so the belief is the diagonal entry.
+ */
+static inline SparseRow ParseSparseRow(const std::string& line) {
+    std::vector<double> fields;
+    tlx::split_view(' ', line, [&](const tlx::string_view& sv) {
+                        if (sv.size() == 0) return;
+                        fields.push_back(atof(sv.to_string().c_str()));
+                    });
+
+    SparseRow r;
+    if (fields.size() < 2) return r;
+    r.id = size_t(fields[0]);
+    r.b = fields[1];
+    std::vector<std::pair<size_t, double> > entries;
+    for (size_t k = 2; k + 1 < fields.size(); k += 2) {
+        size_t j = size_t(fields[k]);
+        if (j == r.id) {
+            r.diag += fields[k + 1];
+            continue;
+        }
+        entries.emplace_back(j, fields[k + 1]);
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<size_t, double>& a,
+                        const std::pair<size_t, double>& b) {
+                         return a.first < b.first;
+                     });
+    for (const std::pair<size_t, double>& e : entries) {
+        if (!r.cols.empty() && r.cols.back() == e.first) {
+            r.vals.back() += e.second;
+            continue;
+        }
+        r.cols.push_back(e.first);
+        r.vals.push_back(e.second);
+    }
+    r.in_p.assign(r.cols.size(), 0.0), r.in_h.assign(r.cols.size(), 0.0);
+    r.out_p = r.in_p, r.out_h = r.in_h;
+    r.p = r.diag, r.h = r.b;
+    r.x = r.p != 0 ? r.h / r.p : 0.0;
+    return r;
+}
+
+//! Belief of a row as seen by its neighbours.
+static inline std::pair<double, double> SparseBelief(const SparseRow& r) {
+    return std::make_pair(r.p, r.h);
+}
+
+/*!
+ * One synchronous GaBP sweep over the local rows. The message of an edge is
+ * computed from the belief of its source without the message coming back
+ * over the edge (the cavity):
+ *
+ *   P_msg = -a^2 / P_cav,  h_msg = -a h_cav / P_cav.
+ *
+ * A row recomputes the message each neighbour sends it from the published
+ * belief of the neighbour, and the message it sends back from its own belief
+ * before the sweep, then sums up its new belief. Returns the summed change of
+ * x.
+ */
+static inline double SparseGaBPSweep(
+    std::vector<SparseRow>& rows,
+    const thrill::api::GraphHalo<std::pair<double, double> >& halo) {
+    double err = 0;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        SparseRow& r = rows[i];
+        double p = r.diag, h = r.b;
+        for (size_t k = 0; k < r.cols.size(); ++k) {
+            const std::pair<double, double>& nb = halo.neighbor(i, k);
+            double a = r.vals[k];
+
+            double cav = nb.first - r.out_p[k];
+            if (cav == 0) cav = 0.00001;
+            double in_p = -a * a / cav;
+            double in_h = -a * (nb.second - r.out_h[k]) / cav;
+
+            cav = r.p - r.in_p[k];
+            if (cav == 0) cav = 0.00001;
+            r.out_p[k] = -a * a / cav;
+            r.out_h[k] = -a * (r.h - r.in_h[k]) / cav;
+
+            r.in_p[k] = in_p, r.in_h[k] = in_h;
+            p += in_p, h += in_h;
+        }
+        r.p = p, r.h = h;
+        double x = p != 0 ? h / p : 0.0;
+        err += std::fabs(x - r.x);
+        r.x = x;
+    }
+    return err;
+}
+
+} // namespace gabp
+
+#endif // !GABP_SPARSE_GABP_HEADER
+
+/******************************************************************************/
@@ -0,0 +1,273 @@
+/*******************************************************************************
+ * gabp/spike_solver.hpp
+ *
+ * Exact partitioned solver for tridiagonal systems (SPIKE), an alternative to
+ * the iterative GaBP sweeps when the matrix is known to be tridiagonal.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef GABP_SPIKE_SOLVER_HEADER
+#define GABP_SPIKE_SOLVER_HEADER
+
+#include <thrill/net/flow_control_channel.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// after all other headers, the column names are plain macros
+#include "row_layout.hpp"
+
+namespace gabp {
+
+/*!
+ * The solver takes the buffer of an InterMap2D(ROW_SIZE, 1, 1) call like
+ * SoAEngine: the first and the last row are halo or sentinel rows, the rows in
+ * between are owned by this worker. Row i stands for the equation
+ *
+ *   BI x_{i-1} + AI x_i + CI x_{i+1} = B.
+ *
+ * Each worker factors its block A_p of owned rows with the Thomas algorithm and
+ * solves A_p y = b and the two spikes A_p v = BI_first e_first and
+ * A_p w = CI_last e_last, which describe how the block depends on x of the last
+ * row of the previous worker and of the first row of the next one. Then
+ *
+ *   x = y - v x_prev - w x_next.
+ *
+ * Written down for the first and the last owned row of every worker, this is
+ * a banded system of at most two unknowns per worker. The coefficients are
+ * gathered with one AllGather, every worker solves the small system and then
+ * computes its own rows, so there is no iteration and no halo exchange.
+ *
+ * Neither the blocks nor the reduced system are pivoted, which is fine for the
+ * symmetric positive definite or diagonally dominant matrices GaBP is run on.
+ * Zero pivots are replaced by 0.00001 as in the GaBP sweeps.
+ *
+ * A row may carry K right hand sides starting at column B, as for SoAEngine.
+ * The factorization and the spikes are shared by all of them.
+ */
+class SpikeSolver
+{
+public:
+    SpikeSolver(const std::vector<double>& values, size_t row_size,
+                size_t num_rhs = 1)
+        : k_(num_rhs) {
+        size_t rows = values.size() / row_size;
+        n_ = rows >= 2 ? rows - 2 : 0;
+
+        lower_.resize(n_), diag_.resize(n_), upper_.resize(n_);
+        b_.resize(n_ * k_);
+        for (size_t i = 0; i < n_; ++i) {
+            const double* row = values.data() + (i + 1) * row_size;
+            lower_[i] = row[BI], diag_[i] = row[AI], upper_[i] = row[CI];
+            for (size_t k = 0; k < k_; ++k)
+                b_[i * k_ + k] = row[B + k];
+        }
+    }
+
+    //! number of rows owned by this worker
+    size_t size() const { return n_; }
+
+    //! number of right hand sides
+    size_t num_rhs() const { return k_; }
+
+    //! Solves the system, collective over all workers.
+    void Solve(thrill::net::FlowControlChannel& net) {
+        SolveLocal();
+
+        std::shared_ptr<std::vector<std::vector<double> > > all =
+            net.AllGather(Interface());
+
+        std::vector<double> x_prev(k_), x_next(k_);
+        std::vector<double> reduced = SolveReduced(*all);
+        Neighbours(*all, reduced, net.my_rank(), x_prev, x_next);
+
+        x_ = y_;
+        for (size_t i = 0; i < n_; ++i) {
+            for (size_t k = 0; k < k_; ++k)
+                x_[i * k_ + k] -= v_[i] * x_prev[k] + w_[i] * x_next[k];
+        }
+    }
+
+    //! x of the owned rows, K values per row
+    const std::vector<double>& Solution() const { return x_; }
+
+private:
+    //! number of right hand sides
+    size_t k_;
+    //! number of owned rows
+    size_t n_;
+
+    //! matrix entries and right hand sides of the owned rows
+    std::vector<double> lower_, diag_, upper_, b_;
+    //! Thomas factorization: modified upper diagonal and inverse pivots
+    std::vector<double> cp_, inv_piv_;
+    //! local solutions and the left and right spike
+    std::vector<double> y_, v_, w_;
+
+    std::vector<double> x_;
+
+    //! replaces zero pivots, as the sweep of GaBP.cpp does
+    static double Guard(double a) { return a == 0 ? 0.00001 : a; }
+
+    //! Factors the owned block and solves for y and both spikes.
+    void SolveLocal() {
+        cp_.resize(n_), inv_piv_.resize(n_);
+        for (size_t i = 0; i < n_; ++i) {
+            double piv = diag_[i] - (i > 0 ? lower_[i] * cp_[i - 1] : 0.0);
+            inv_piv_[i] = 1.0 / Guard(piv);
+            cp_[i] = upper_[i] * inv_piv_[i];
+        }
+
+        y_ = b_;
+        Substitute(y_, k_);
+        v_.assign(n_, 0.0), w_.assign(n_, 0.0);
+        if (n_ > 0) {
+            v_[0] = lower_[0];
+            w_[n_ - 1] = upper_[n_ - 1];
+        }
+        Substitute(v_, 1);
+        Substitute(w_, 1);
+    }
+
+    //! Forward and back substitution with the factored block for count right
+    //! hand sides stored row-major in r.
+    void Substitute(std::vector<double>& r, size_t count) const {
+        for (size_t i = 0; i < n_; ++i) {
+            for (size_t k = 0; k < count; ++k) {
+                double s = r[i * count + k];
+                if (i > 0) s -= lower_[i] * r[(i - 1) * count + k];
+                r[i * count + k] = s * inv_piv_[i];
+            }
+        }
+        for (size_t i = n_; i-- > 1; ) {
+            for (size_t k = 0; k < count; ++k)
+                r[(i - 1) * count + k] -= cp_[i - 1] * r[i * count + k];
+        }
+    }
+
+    /*!
+     * Values this worker contributes to the reduced system: nothing without
+     * owned rows, else the spikes v and w at the first and the last row,
+     * followed by y of the first and of the last row.
+     */
+    std::vector<double> Interface() const {
+        std::vector<double> out;
+        if (n_ == 0) return out;
+        out = { v_[0], v_[n_ - 1], w_[0], w_[n_ - 1], double(n_) };
+        out.insert(out.end(), y_.begin(), y_.begin() + k_);
+        out.insert(out.end(), y_.end() - k_, y_.end());
+        return out;
+    }
+
+    //! index of the unknowns of the first and the last row of each worker in
+    //! the reduced system, -1 for workers without rows
+    struct Unknowns {
+        std::vector<long> first, last;
+        size_t size = 0;
+    };
+
+    static Unknowns Number(const std::vector<std::vector<double> >& all) {
+        Unknowns u;
+        u.first.assign(all.size(), -1), u.last.assign(all.size(), -1);
+        for (size_t p = 0; p < all.size(); ++p) {
+            if (all[p].empty()) continue;
+            u.first[p] = u.size++;
+            // with a single row, the first row is the last one
+            u.last[p] = all[p][4] > 1 ? u.size++ : u.first[p];
+        }
+        return u;
+    }
+
+    /*!
+     * Builds and solves the reduced system, returns the K values of x of the
+     * first and the last row of each worker, indexed as by Number(). Unknown j
+     * only couples to unknowns j-2..j+2, so the elimination runs on a band.
+     */
+    std::vector<double> SolveReduced(
+        const std::vector<std::vector<double> >& all) const {
+        Unknowns u = Number(all);
+        const size_t m = u.size;
+        constexpr long bw = 2;
+
+        // band[j * 5 + (c - j + 2)] is the coefficient of unknown c in row j
+        std::vector<double> band(m * 5, 0.0), rhs(m * k_, 0.0);
+        auto set = [&](long j, long c, double a) {
+            if (c >= 0) band[j * 5 + (c - j + bw)] += a;
+        };
+
+        long prev_last = -1;
+        for (size_t p = 0; p < all.size(); ++p) {
+            if (all[p].empty()) continue;
+            const std::vector<double>& f = all[p];
+            long next_first = -1;
+            for (size_t q = p + 1; q < all.size() && next_first < 0; ++q)
+                next_first = u.first[q];
+
+            // x_first + v_first x_prev + w_first x_next = y_first, and the
+            // same for the last row if it is a different one
+            set(u.first[p], u.first[p], 1.0);
+            set(u.first[p], prev_last, f[0]);
+            set(u.first[p], next_first, f[2]);
+            for (size_t k = 0; k < k_; ++k)
+                rhs[u.first[p] * k_ + k] = f[5 + k];
+
+            if (u.last[p] != u.first[p]) {
+                set(u.last[p], u.last[p], 1.0);
+                set(u.last[p], prev_last, f[1]);
+                set(u.last[p], next_first, f[3]);
+                for (size_t k = 0; k < k_; ++k)
+                    rhs[u.last[p] * k_ + k] = f[5 + k_ + k];
+            }
+            prev_last = u.last[p];
+        }
+
+        // band elimination without pivoting
+        for (long c = 0; c < long(m); ++c) {
+            double inv = 1.0 / Guard(band[c * 5 + bw]);
+            for (long j = c + 1; j <= c + bw && j < long(m); ++j) {
+                double f = band[j * 5 + (c - j + bw)] * inv;
+                if (f == 0) continue;
+                for (long e = c; e <= c + bw && e < long(m); ++e)
+                    band[j * 5 + (e - j + bw)] -= f * band[c * 5 + (e - c + bw)];
+                for (size_t k = 0; k < k_; ++k)
+                    rhs[j * k_ + k] -= f * rhs[c * k_ + k];
+            }
+        }
+        for (long c = long(m) - 1; c >= 0; --c) {
+            double inv = 1.0 / Guard(band[c * 5 + bw]);
+            for (size_t k = 0; k < k_; ++k) {
+                double s = rhs[c * k_ + k];
+                for (long e = c + 1; e <= c + bw && e < long(m); ++e)
+                    s -= band[c * 5 + (e - c + bw)] * rhs[e * k_ + k];
+                rhs[c * k_ + k] = s * inv;
+            }
+        }
+        return rhs;
+    }
+
+    //! Picks x of the last row of the previous worker with rows and of the
+    //! first row of the next one out of the reduced solution, zero at the ends.
+    void Neighbours(const std::vector<std::vector<double> >& all,
+                    const std::vector<double>& reduced, size_t rank,
+                    std::vector<double>& x_prev,
+                    std::vector<double>& x_next) const {
+        Unknowns u = Number(all);
+        long prev = -1, next = -1;
+        for (size_t p = rank; p-- > 0 && prev < 0; ) prev = u.last[p];
+        for (size_t p = rank + 1; p < all.size() && next < 0; ++p) next = u.first[p];
+
+        for (size_t k = 0; k < k_; ++k) {
+            x_prev[k] = prev >= 0 ? reduced[prev * k_ + k] : 0.0;
+            x_next[k] = next >= 0 ? reduced[next * k_ + k] : 0.0;
+        }
+    }
+};
+
+} // namespace gabp
+
+#endif // !GABP_SPIKE_SOLVER_HEADER
+
+/******************************************************************************/
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ * gabp_convert.cpp
+ *
+ * Converts GaBP matrix rows from the text format, one row of space separated
+ * numbers per line, into a binary rows file read by GaBP --binary.
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#include <thrill/api/read_binary_rows.hpp>
+#include <tlx/cmdline_parser.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace thrill; // NOLINT
+
+//! Parses the numbers of one text line into row, returns their count.
+static size_t ParseRow(const std::string& line, std::vector<double>& row) {
+    row.clear();
+    const char* p = line.c_str();
+    char* end;
+    while (true) {
+        double v = std::strtod(p, &end);
+        if (end == p) break;
+        row.push_back(v);
+        p = end;
+    }
+    return row.size();
+}
+
+int main(int argc, char* argv[]) {
+
+    tlx::CmdlineParser clp;
+
+    size_t row_size = 0;
+    clp.add_size_t('w', "width", row_size,
+                   "numbers per row, default: taken from the first row");
+    std::string input;
+    clp.add_param_string("input", input,
+                         "text file with one matrix row per line");
+    std::string output;
+    clp.add_param_string("output", output,
+                         "binary rows file to write");
+
+    if (!clp.process(argc, argv)) {
+        return -1;
+    }
+
+    std::ifstream in(input);
+    if (!in.good()) {
+        std::cerr << "gabp_convert: cannot open " << input << std::endl;
+        return -1;
+    }
+    std::ofstream out(output, std::ios::binary);
+    if (!out.good()) {
+        std::cerr << "gabp_convert: cannot create " << output << std::endl;
+        return -1;
+    }
+
+    // the header is written again once the number of rows is known
+    api::BinaryRowsHeader header =
+        api::BinaryRowsHeader::Make<double>(row_size, 0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::string line;
+    std::vector<double> row;
+    size_t rows = 0, line_num = 0;
+    while (std::getline(in, line)) {
+        ++line_num;
+        if (ParseRow(line, row) == 0) continue;
+
+        if (row_size == 0) row_size = row.size();
+        if (row.size() != row_size) {
+            std::cerr << "gabp_convert: line " << line_num << " of " << input
+                      << " has " << row.size() << " numbers, expected "
+                      << row_size << std::endl;
+            return -1;
+        }
+
+        out.write(reinterpret_cast<const char*>(row.data()),
+                  row.size() * sizeof(double));
+        ++rows;
+    }
+
+    header = api::BinaryRowsHeader::Make<double>(row_size, rows);
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+
+    if (!out.good()) {
+        std::cerr << "gabp_convert: error writing " << output << std::endl;
+        return -1;
+    }
+
+    std::cout << "gabp_convert: wrote " << rows << " rows of " << row_size
+              << " numbers to " << output << std::endl;
+
+    return 0;
+}
+
+/******************************************************************************/
@@ -1246,6 +1246,14 @@ data::CatStreamPtr Context::GetNewCatStream(DIABase* dia) {
     return GetNewCatStream(dia != nullptr ? dia->dia_id() : 0);
 }
 
+data::PeerChannel& Context::peer_channel() {
+    if (!peer_channel_) {
+        peer_channel_ = std::make_unique<data::PeerChannel>(
+            GetNewCatStream(size_t(0)));
+    }
+    return *peer_channel_;
+}
+
 data::MixStreamPtr Context::GetNewMixStream(size_t dia_id) {
     return multiplexer_.GetNewMixStream(local_worker_id_, dia_id);
 }
@@ -1324,6 +1332,9 @@ void Context::Launch(const std::function<void(Context&)>& job_startpoint) {
         throw;
     }
 
+    // all workers are done with their exchanges, close the channel
+    peer_channel_.reset();
+
     logger_ << "class" << "Context"
             << "event" << "job-done"
             << "elapsed" << overall_timer;
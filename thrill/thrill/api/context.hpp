@@ -14,6 +14,7 @@
 #ifndef THRILL_API_CONTEXT_HEADER
 #define THRILL_API_CONTEXT_HEADER
 
+#include <thrill/common/cartesian_grid.hpp>
 #include <thrill/common/config.hpp>
 #include <thrill/common/defines.hpp>
 #include <thrill/common/json_logger.hpp>
@@ -23,6 +24,7 @@
 #include <thrill/data/file.hpp>
 #include <thrill/data/mix_stream.hpp>
 #include <thrill/data/multiplexer.hpp>
+#include <thrill/data/peer_channel.hpp>
 #include <thrill/net/flow_control_channel.hpp>
 #include <thrill/net/flow_control_manager.hpp>
 #include <thrill/net/manager.hpp>
@@ -30,6 +32,7 @@
 #include <algorithm>
 #include <cassert>
 #include <functional>
+#include <memory>
 #include <numeric>
 #include <random>
 #include <string>
@@ -315,6 +318,12 @@ public:
     //! communication coordination.
     data::MixStreamPtr GetNewMixStream(DIABase* dia);
 
+    //! Returns the PeerChannel of this worker for messages between single
+    //! pairs of workers. It is created by the first call, which must happen at
+    //! the same point on all Workers, like GetNewCatStream(), and is closed
+    //! when the job is done.
+    data::PeerChannel& peer_channel();
+
     //! Returns a reference to a new CatStream or MixStream, selectable via
     //! template parameter.
     template <typename Stream>
@@ -345,25 +354,25 @@ public:
         return common::CalculateLocalRange(rows, columns, num_workers(), my_rank());
     }
 
+    //! range of the rows (isRow == 1) or of the columns of the tile of a rows
+    //! x columns grid which this worker holds in the CartesianGrid of all
+    //! workers.
     common::Range CalculateLocalRange2D(size_t isRow, size_t rows, size_t columns) const {
-        return common::CalculateLocalRange(isRow ==1 ? rows : columns, sqrt(num_workers()), isRow == 1 ? my_rank()/(int)sqrt(num_workers()) : my_rank()%(int)sqrt(num_workers()));
+        common::CartesianGrid<2> grid({ { rows, columns } }, num_workers());
+        size_t dim = isRow == 1 ? 0 : 1;
+        return grid.LocalRange(dim, grid.Coordinates(my_rank())[dim]);
     }
 
+    //! range of the x (type 0), y (type 1) or z (type 2) indexes of the tile
+    //! of an x_size x y_size x z_size grid which this worker holds in the
+    //! CartesianGrid of all workers. z is the slowest dimension of the worker
+    //! grid and y the fastest.
     common::Range CalculateLocalRange3D(size_t type, size_t x_size, size_t y_size, size_t z_size) const {
-
-        int sub_workers = (int)pow(num_workers(),1.0/3);
-        if(type == 0){
-            return common::CalculateLocalRange(x_size, sub_workers, (my_rank()%(sub_workers * sub_workers)) / sub_workers);
-        }
-        else if(type == 1){
-            return common::CalculateLocalRange(y_size, sub_workers, my_rank()%(sub_workers * sub_workers) % sub_workers);
-        }
-        else{
-            return common::CalculateLocalRange(z_size, sub_workers, my_rank()/(sub_workers * sub_workers));
-        }
+        common::CartesianGrid<3> grid({ { z_size, x_size, y_size } }, num_workers());
+        size_t dim = type == 0 ? 1 : type == 1 ? 2 : 0;
+        return grid.LocalRange(dim, grid.Coordinates(my_rank())[dim]);
     }
 
-
     common::Range CalculateLocalRangeOnHost(size_t global_size) const {
         return common::CalculateLocalRange(
             global_size, workers_per_host(), local_worker_id());
@@ -452,6 +461,9 @@ private:
     //! the number of valid DIA ids. 0 is reserved for invalid.
     size_t last_dia_id_ = 0;
 
+    //! created by peer_channel(), closed at the end of Launch()
+    std::unique_ptr<data::PeerChannel> peer_channel_;
+
 public:
     //! \name Shared Objects
     //! \{
@@ -24,6 +24,7 @@
 #include <thrill/common/functional.hpp>
 #include <tlx/meta/function_stack.hpp>
 
+#include <array>
 #include <cassert>
 #include <functional>
 #include <ostream>
@@ -2032,18 +2033,137 @@ public:
      */
     auto Rebalance() const;
 
+    /*!
+     * InterMap1D hands the worker's values together with left_neighber_count
+     * values of the preceding and right_neighber_count values of the
+     * following workers to inter_map_function. If periodic, the first worker
+     * gets the last values of the DIA in front and the last worker the first
+     * ones behind.
+     */
     template <typename InterMapFunction>
-    auto InterMap1D(const InterMapFunction& inter_map_function, size_t left_neighber_count, size_t right_neighber_count) const;
+    auto InterMap1D(const InterMapFunction& inter_map_function, size_t left_neighber_count, size_t right_neighber_count, bool periodic = false) const;
 
+    /*!
+     * InterMap2D hands the worker's lines of line_element_num values together
+     * with up_lines and down_lines halo lines of the neighbouring workers to
+     * inter_map_function, either as a std::vector<ValueType> which it returns
+     * the values of the new DIA from, or as the views f(input, up, output) of
+     * InterMap2DNode, which fill the preallocated output in place.
+     */
     template <typename InterMapFunction>
     auto InterMap2D(const InterMapFunction& inter_map_function, size_t line_element_num, size_t up_lines, size_t down_lines) const;
+    /*!
+     * Stencil variant of InterMap2D on a rows x columns grid: the function
+     * maps each point and its neighbours up to left_size, right_size, up_size
+     * and down_size points away to the new point, taking either a
+     * Stencil2DNeighbors accessor or vectors of the neighbours. With corners,
+     * the accessor also reaches the diagonal neighbours within these widths,
+     * for 9-point and other box stencils. periodic tells whether the rows and
+     * the columns wrap around the grid.
+     */
     template <typename InterMapFunction>
-    auto InterMap2D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t left_size, size_t right_size, size_t up_size, size_t down_size) const;
+    auto InterMap2D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t left_size, size_t right_size, size_t up_size, size_t down_size, bool corners = false,
+                    const std::array<bool, 2>& periodic = std::array<bool, 2>()) const;
+
+    /*!
+     * InterMap2D variant whose function returns std::pair<std::vector<ValueType>,
+     * AuxType>: the values of the resulting DIA and an auxiliary value, e.g. the
+     * residual of the partition. The auxiliary values of all workers are
+     * combined with reduce_function and written to aux_result when the stage
+     * runs, so that the driver reads it after Execute() without another stage
+     * and without storing it among the values.
+     *
+     * Like InterMap2D, it also takes a function on views, f(input, up,
+     * output), which fills output and returns the auxiliary value.
+     */
+    template <typename InterMapFunction, typename AuxType,
+              typename ReduceFunction = std::plus<AuxType> >
+    auto InterMap2DAllReduce(const InterMapFunction& inter_map_function, size_t line_element_num, size_t up_lines, size_t down_lines,
+                             AuxType& aux_result, const ReduceFunction& reduce_function = ReduceFunction()) const;
 
     template <typename InterMapFunction>
     auto InterMap3D(const InterMapFunction& inter_map_function, size_t table_element_num, size_t up_tables, size_t down_tables) const;
+    /*!
+     * Stencil variant of InterMap3D on a layers x rows x columns grid, like
+     * the one of InterMap2D: the function takes either a Stencil3DNeighbors
+     * accessor or vectors of the neighbours, and with corners the accessor
+     * also reaches the edge and corner neighbours, for 27-point stencils.
+     * periodic tells whether the rows, columns and layers wrap around.
+     */
     template <typename InterMapFunction>
-    auto InterMap3D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t layers, size_t left_size, size_t right_size, size_t up_size, size_t down_size, size_t front_size, size_t back_size) const;
+    auto InterMap3D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t layers, size_t left_size, size_t right_size, size_t up_size, size_t down_size, size_t front_size, size_t back_size, bool corners = false,
+                    const std::array<bool, 3>& periodic = std::array<bool, 3>()) const;
+
+    /*!
+     * IterateInterMap is a DOp, which runs an InterMap2D-like function up to
+     * max_iterations times on a partition that stays resident on the worker.
+     * Before each iteration up_lines and down_lines lines of line_element_num
+     * items are fetched from the neighbouring workers. The function gets the
+     * buffer [up halo | local items | down halo] as std::vector<ValueType>&,
+     * updates it in place and returns the local residual as double.
+     *
+     * Every check_interval iterations the residuals are summed up over all
+     * workers and passed to converged_function(residual, iteration), the loop
+     * stops on all workers once it returns true. The resulting DIA contains the
+     * local items after the last iteration.
+     *
+     * \ingroup dia_dops
+     */
+    template <typename IterateFunction, typename ConvergedFunction>
+    auto IterateInterMap(const IterateFunction& iterate_function,
+                         size_t line_element_num,
+                         size_t up_lines, size_t down_lines,
+                         size_t max_iterations,
+                         const ConvergedFunction& converged_function,
+                         size_t check_interval = 1) const;
+
+    /*!
+     * IterateInterMap variant which refreshes only the items up_fields of the
+     * up halo lines and down_fields of the down halo lines after the first
+     * iteration, e.g. the outgoing messages of a row. The other items of the
+     * halo lines keep the values of the first exchange. The iterations are
+     * counted from first_iteration, e.g. to resume a loop from a checkpoint.
+     *
+     * \ingroup dia_dops
+     */
+    template <typename IterateFunction, typename ConvergedFunction>
+    auto IterateInterMap(const IterateFunction& iterate_function,
+                         size_t line_element_num,
+                         size_t up_lines, size_t down_lines,
+                         const std::vector<size_t>& up_fields,
+                         const std::vector<size_t>& down_fields,
+                         size_t max_iterations,
+                         const ConvergedFunction& converged_function,
+                         size_t check_interval = 1,
+                         size_t first_iteration = 0) const;
+
+    /*!
+     * InterMapGraph is a DOp, which iterates a function over the vertices of a
+     * general sparse graph. Each item is a vertex with id id_function(item),
+     * the ids must be 0..n-1, and neighbors_function(item) returns the ids it
+     * is connected to. The items are distributed to the workers in contiguous
+     * id ranges and the ghost lists are computed once.
+     *
+     * Before each iteration, publish_function(item) gives the value of each
+     * vertex seen by its neighbours, and the values of the ghost vertices are
+     * exchanged. iterate_function(std::vector<ValueType>& items, const
+     * GraphHalo<HaloType>& halo), where HaloType is the result type of
+     * publish_function, then updates the local items, which are sorted
+     * by id, and returns the local residual as double. Convergence is checked
+     * as for IterateInterMap. The resulting DIA holds the items sorted by id.
+     *
+     * \ingroup dia_dops
+     */
+    template <typename IdFunction, typename NeighborsFunction,
+              typename PublishFunction, typename IterateFunction,
+              typename ConvergedFunction>
+    auto InterMapGraph(const IdFunction& id_function,
+                       const NeighborsFunction& neighbors_function,
+                       const PublishFunction& publish_function,
+                       const IterateFunction& iterate_function,
+                       size_t max_iterations,
+                       const ConvergedFunction& converged_function,
+                       size_t check_interval = 1) const;
 
 
 
@@ -0,0 +1,130 @@
+/*******************************************************************************
+ * thrill/api/halo_buffer.hpp
+ *
+ * Worker-local buffer of the InterMap operators which keeps slack in front of
+ * the local items, such that the halo of the predecessor lands in place.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_API_HALO_BUFFER_HEADER
+#define THRILL_API_HALO_BUFFER_HEADER
+
+#include <thrill/common/span.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace thrill {
+namespace api {
+
+/*!
+ * HaloBuffer collects the local items of an InterMap operator behind front
+ * slack items and then takes the halos of the neighbours, which makes up the
+ * layout [front halo | local items | back halo] without moving the local
+ * items. The front halo is copied into the slack, the back halo appended.
+ *
+ * The slack is reserved before the items arrive, so it has to be the size of
+ * the expected front halo: the halo lines of the predecessor, none on the
+ * first worker. A larger halo is inserted in front, which moves the items as
+ * before, a smaller one leaves a gap in front which is not part of the buffer.
+ */
+template <typename ValueType>
+class HaloBuffer
+{
+public:
+    //! Drops all items and reserves slack front items.
+    void Reset(size_t slack) {
+        values_.clear();
+        values_.resize(slack);
+        begin_ = slack;
+        front_ = back_ = 0;
+    }
+
+    void push_back(const ValueType& v) { values_.push_back(v); }
+
+    //! number of local items
+    size_t local_size() const { return size() - front_ - back_; }
+
+    //! number of front and back halo items
+    size_t front_size() const { return front_; }
+    size_t back_size() const { return back_; }
+
+    //! Copies the first k local items to send to the predecessor.
+    std::vector<ValueType> Front(size_t k) const {
+        auto local_begin = values_.begin() + begin_ + front_;
+        return std::vector<ValueType>(
+            local_begin, local_begin + std::min(k, local_size()));
+    }
+
+    //! Copies the last k local items to send to the successor.
+    std::vector<ValueType> Back(size_t k) const {
+        auto local_end = values_.end() - back_;
+        return std::vector<ValueType>(
+            local_end - std::min(k, local_size()), local_end);
+    }
+
+    //! Places the halo received from the predecessor in front of the items.
+    void AttachFront(const std::vector<ValueType>& halo) {
+        if (halo.size() <= begin_) {
+            begin_ -= halo.size();
+            std::copy(halo.begin(), halo.end(), values_.begin() + begin_);
+        }
+        else {
+            values_.erase(values_.begin(), values_.begin() + begin_);
+            values_.insert(values_.begin(), halo.begin(), halo.end());
+            begin_ = 0;
+        }
+        front_ += halo.size();
+    }
+
+    //! Places the halo received from the successor behind the items.
+    void AttachBack(const std::vector<ValueType>& halo) {
+        values_.insert(values_.end(), halo.begin(), halo.end());
+        back_ += halo.size();
+    }
+
+    //! view of the halos and the local items
+    common::Span<const ValueType> view() const {
+        return common::Span<const ValueType>(values_.data() + begin_, size());
+    }
+
+    size_t size() const { return values_.size() - begin_; }
+
+    /*!
+     * The halos and the local items as a vector, for the functions which take
+     * one. Only an unused part of the slack has to be dropped for this, which
+     * moves the items.
+     */
+    const std::vector<ValueType>& vector() {
+        if (begin_ != 0) {
+            values_.erase(values_.begin(), values_.begin() + begin_);
+            begin_ = 0;
+        }
+        return values_;
+    }
+
+    //! Releases the memory.
+    void Clear() {
+        std::vector<ValueType>().swap(values_);
+        begin_ = front_ = back_ = 0;
+    }
+
+private:
+    //! [unused slack | front halo | local items | back halo]
+    std::vector<ValueType> values_;
+    //! index of the first item of the front halo
+    size_t begin_ = 0;
+    size_t front_ = 0, back_ = 0;
+};
+
+} // namespace api
+} // namespace thrill
+
+#endif // !THRILL_API_HALO_BUFFER_HEADER
+
+/******************************************************************************/
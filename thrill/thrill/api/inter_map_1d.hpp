@@ -14,17 +14,24 @@
 
 #include <thrill/api/dia.hpp>
 #include <thrill/api/dop_node.hpp>
+#include <thrill/api/halo_buffer.hpp>
 #include <thrill/common/logger.hpp>
 #include <thrill/data/file.hpp>
 #include <thrill/data/block_writer.hpp>
 
 #include <algorithm>
+#include <utility>
 #include <vector>
 
 namespace thrill {
 namespace api {
     
 /*!
+ * InterMap1DNode hands the worker's values with the neighbouring workers'
+ * values around them to the function. The halos come from the predecessor and
+ * the successor, and if periodic, the first and the last worker exchange
+ * theirs directly over the Context's PeerChannel, so the DIA wraps around.
+ *
  * \ingroup api_layer
  */
 template <typename ValueType,typename InterMapFunction>
@@ -37,14 +44,13 @@ public:
     using Super::context_;
  
     template <typename ParentDIA>
-    explicit InterMap1DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function,size_t left_neighber_count,size_t right_neighber_count)
+    explicit InterMap1DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function,size_t left_neighber_count,size_t right_neighber_count, bool periodic)
         : Super(parent.ctx(), "InterMap1D", { parent.id() }, { parent.node() })
         ,parent_stack_empty_(ParentDIA::stack_empty),
         inter_map_function_(inter_map_function),
         left_neighber_count_(left_neighber_count),
         right_neighber_count_(right_neighber_count),
-        cat_stream_(parent.ctx().GetNewCatStream(this))
-        ,emitters_(cat_stream_->GetWriters()) 
+        periodic_(periodic)
         {
         auto pre_op_fn = [this](const ValueType& input) {
                            PreOp(input);
@@ -54,6 +60,8 @@ public:
         my_rank_ = this->context().my_rank();
         total_rank_ = this->context().num_hosts() * this->context().workers_per_host();
 
+        // the first worker gets no items from a predecessor, unless periodic
+        values_.Reset(my_rank_ > 0 || periodic_ ? left_neighber_count_ : 0);
     }
 
     void PreOp(const ValueType& input) {
@@ -64,15 +72,22 @@ public:
     }
 
     void StopPreOp(size_t parent_index) final {
-        size_t size = values_.size();
+        size_t size = values_.local_size();
         if(left_neighber_count_ > size)
             left_neighber_count_ = size;
         if(right_neighber_count_ > size)
             right_neighber_count_ = size;
 
-       left_values_ = context_.net.Predecessor(left_neighber_count_, values_);
-       right_values_ = context_.net.Successor(right_neighber_count_, values_);
+       std::vector<ValueType> left_values = context_.net.Predecessor(
+           left_neighber_count_, values_.Back(left_neighber_count_));
+       std::vector<ValueType> right_values = context_.net.Successor(
+           right_neighber_count_, values_.Front(right_neighber_count_));
+       if (periodic_)
+           WrapAround(left_values, right_values);
 
+       // the left items go into the slack in front of the local items
+       values_.AttachFront(left_values);
+       values_.AttachBack(right_values);
     }
 
     //! Executes the rebalance operation.
@@ -82,10 +97,31 @@ public:
     }
 
     void ProcessChannel(){
-        int i;
-        values_.insert(values_.begin(),left_values_.begin(),left_values_.end());
-        values_.insert(values_.end(),right_values_.begin(),right_values_.end());
+    }
 
+    //! Sends the last items of the last worker to the first one and the first
+    //! items of the first worker to the last one, which have no predecessor
+    //! and no successor. No other worker takes part.
+    void WrapAround(std::vector<ValueType>& left_values,
+                    std::vector<ValueType>& right_values) {
+        data::PeerChannel& channel = context_.peer_channel();
+        size_t last = total_rank_ - 1;
+        // with a single worker, both messages go to itself in this order
+        if (my_rank_ == last)
+            channel.Send(0, this->dia_id(), values_.Back(left_neighber_count_));
+        if (my_rank_ == 0)
+            channel.Send(last, this->dia_id(), values_.Front(right_neighber_count_));
+
+        if (my_rank_ == 0) {
+            for (const ValueType& v :
+                 channel.template Receive<ValueType>(last, this->dia_id()))
+                left_values.push_back(v);
+        }
+        if (my_rank_ == last) {
+            for (const ValueType& v :
+                 channel.template Receive<ValueType>(0, this->dia_id()))
+                right_values.push_back(v);
+        }
     }
 
 
@@ -93,7 +129,7 @@ public:
 
         ProcessChannel();
 
-        std::vector<ValueType> result = inter_map_function_(values_);
+        std::vector<ValueType> result = inter_map_function_(values_.vector());
 
  
         typename std::vector<ValueType>::iterator itr = result.begin();
@@ -105,33 +141,32 @@ public:
     }
 
     void Dispose() final {
+        values_.Clear();
     }
 
 private:
     //! Whether the parent stack is empty
     const bool parent_stack_empty_;
 
-    std::vector<ValueType> values_;
-    std::vector<ValueType> left_values_;
-    std::vector<ValueType> right_values_;
+    //! the local items with the neighbours' items around them
+    HaloBuffer<ValueType> values_;
  
     size_t my_rank_;
     size_t total_rank_;
 
     size_t left_neighber_count_;
     size_t right_neighber_count_;
+    //! whether the first and the last worker are neighbours
+    bool periodic_;
 
-    //data::MixStreamPtr mix_stream_;
-    data::CatStreamPtr cat_stream_;
-    data::Stream::Writers emitters_;
     InterMapFunction inter_map_function_;
 };
 
 template <typename ValueType, typename Stack>
 template <typename InterMapFunction>
-auto DIA<ValueType, Stack>::InterMap1D(const InterMapFunction& inter_map_function, size_t left_neighber_count, size_t right_neighber_count) const {
+auto DIA<ValueType, Stack>::InterMap1D(const InterMapFunction& inter_map_function, size_t left_neighber_count, size_t right_neighber_count, bool periodic) const {
     using InterMap1DNode = api::InterMap1DNode<ValueType,InterMapFunction>;
-    return DIA<ValueType>(tlx::make_counting<InterMap1DNode>(*this, inter_map_function, left_neighber_count, right_neighber_count));
+    return DIA<ValueType>(tlx::make_counting<InterMap1DNode>(*this, inter_map_function, left_neighber_count, right_neighber_count, periodic));
 }
 
 } // namespace api
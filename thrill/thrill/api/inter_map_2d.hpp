@@ -14,20 +14,44 @@
 
 #include <thrill/api/dia.hpp>
 #include <thrill/api/dop_node.hpp>
+#include <thrill/api/halo_buffer.hpp>
+#include <thrill/common/function_traits.hpp>
 #include <thrill/common/logger.hpp>
+#include <thrill/common/span.hpp>
 #include <thrill/data/file.hpp>
 #include <thrill/data/block_writer.hpp>
 
 #include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace thrill {
 namespace api {
     
 /*!
+ * InterMap2DNode hands the worker's lines with up_lines and down_lines halo
+ * lines of the neighbouring workers to the function and pushes the values it
+ * returns.
+ *
+ * If the function returns std::pair<std::vector<ValueType>, AuxType>, the
+ * second value is combined over all workers with reduce_function and stored in
+ * *aux_result once the values are pushed, see InterMap2DAllReduce().
+ *
+ * A function with three parameters works on views instead of vectors:
+ *
+ *   f(common::Span<const ValueType> input, size_t up, common::Span<ValueType> output)
+ *
+ * input is the buffer with the halo lines, of which the first up values come
+ * from the predecessor. output has room for as many values as the worker holds
+ * and is pushed after the call, so neither the buffer is copied into the call
+ * nor a result vector built. It returns void or the auxiliary value.
+ *
  * \ingroup api_layer
  */
-template <typename ValueType,typename InterMapFunction>
+template <typename ValueType, typename InterMapFunction,
+          typename AuxType = void, typename ReduceFunction = std::plus<int> >
 class InterMap2DNode final : public DOpNode<ValueType>
 {
     static constexpr bool debug = false;
@@ -37,13 +61,16 @@ public:
     using Super::context_;
  
     template <typename ParentDIA>
-    explicit InterMap2DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function,size_t line_element_num, size_t up_lines, size_t down_lines)
+    explicit InterMap2DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function,size_t line_element_num, size_t up_lines, size_t down_lines,
+                            AuxType* aux_result = nullptr, const ReduceFunction& reduce_function = ReduceFunction())
         : Super(parent.ctx(), "InterMap2D", { parent.id() }, { parent.node() })
         ,parent_stack_empty_(ParentDIA::stack_empty),
         inter_map_function_(inter_map_function),
         line_element_num_(line_element_num),
         up_lines_(up_lines),
-        down_lines_(down_lines)
+        down_lines_(down_lines),
+        aux_result_(aux_result),
+        reduce_function_(reduce_function)
         {
         auto pre_op_fn = [this](const ValueType& input) {
                            PreOp(input);
@@ -53,6 +80,8 @@ public:
         my_rank_ = this->context().my_rank();
         total_rank_ = this->context().num_hosts() * this->context().workers_per_host();
 
+        // the first worker gets no lines from a predecessor
+        values_.Reset(my_rank_ > 0 ? line_element_num_ * up_lines_ : 0);
     }
 
     void PreOp(const ValueType& input) {
@@ -65,22 +94,19 @@ public:
 
     void StopPreOp(size_t parent_index) final {
 
-        size_t size = values_.size();
         size_t up_num = line_element_num_ * up_lines_;
         size_t down_num = line_element_num_ * down_lines_;
+        std::vector<ValueType> up_values, down_values;
         if(up_num > 0){
-            up_values_ = context_.net.Predecessor(up_num,values_);
+            up_values = context_.net.Predecessor(up_num, values_.Back(up_num));
         }
         if(down_num > 0){
-            down_values_ = context_.net.Successor(down_num,values_);
+            down_values = context_.net.Successor(down_num, values_.Front(down_num));
         }
 
-        if(up_values_.size() > 0){
-            values_.insert(values_.begin(),up_values_.begin(),up_values_.end());
-        } 
-        if(down_values_.size() > 0){
-            values_.insert(values_.end(),down_values_.begin(),down_values_.end());
-        }
+        // the up lines go into the slack in front of the local lines
+        values_.AttachFront(up_values);
+        values_.AttachBack(down_values);
     }
 
     //! Executes the rebalance operation.
@@ -97,9 +123,51 @@ public:
 
         ProcessChannel();
 
-        std::vector<ValueType> result = inter_map_function_(values_);
+        Run(std::integral_constant<
+                bool, common::FunctionTraits<InterMapFunction>::arity == 3>());
+    }
+
+    void Dispose() final {
+
+
+	    values_.Clear();
+	    out_.clear();
+	    out_.shrink_to_fit();
+
+    }
+
+private:
+    //! Calls the function on a copy of the buffer and pushes what it returns.
+    void Run(std::false_type /* views */) {
+        Emit(inter_map_function_(values_.vector()));
+    }
+
+    //! Calls the function on views of the buffer and of out_, then pushes out_.
+    void Run(std::true_type /* views */) {
+        size_t up = values_.front_size();
+        out_.resize(values_.local_size());
+
+        common::Span<const ValueType> input = values_.view();
+        common::Span<ValueType> output(out_.data(), out_.size());
+        using Result = typename common::FunctionTraits<InterMapFunction>::result_type;
+        RunViews(input, up, output, std::is_void<Result>());
+    }
+
+    void RunViews(common::Span<const ValueType> input, size_t up,
+                  common::Span<ValueType> output, std::true_type /* void */) {
+        inter_map_function_(input, up, output);
+        Emit(out_);
+    }
+
+    void RunViews(common::Span<const ValueType> input, size_t up,
+                  common::Span<ValueType> output, std::false_type /* void */) {
+        auto aux = inter_map_function_(input, up, output);
+        Emit(out_);
+        *aux_result_ = context_.net.AllReduce(aux, reduce_function_);
+    }
 
-        typename std::vector<ValueType>::iterator itr = result.begin();
+    void Emit(const std::vector<ValueType>& result) {
+        typename std::vector<ValueType>::const_iterator itr = result.begin();
 
         for(; itr!=result.end();++itr)
         { 
@@ -107,25 +175,20 @@ public:
         }
     }
 
-    void Dispose() final {
-
-
-	    values_.clear();
-	    values_.shrink_to_fit();
-	    up_values_.clear();
-	    up_values_.shrink_to_fit();
-	    down_values_.clear();
-	    down_values_.shrink_to_fit();
-
+    //! Pushes the values and reduces the auxiliary value over all workers.
+    template <typename Aux>
+    void Emit(const std::pair<std::vector<ValueType>, Aux>& result) {
+        Emit(result.first);
+        *aux_result_ = context_.net.AllReduce(result.second, reduce_function_);
     }
 
-private:
     //! Whether the parent stack is empty
     const bool parent_stack_empty_;
 
-    std::vector<ValueType> values_;
-    std::vector<ValueType> up_values_;
-    std::vector<ValueType> down_values_;
+    //! the local lines with the halo lines around them
+    HaloBuffer<ValueType> values_;
+    //! output of a function on views, reused between calls
+    std::vector<ValueType> out_;
 
     size_t my_rank_;
     size_t total_rank_;
@@ -135,6 +198,10 @@ private:
     size_t down_lines_;
 
     InterMapFunction inter_map_function_;
+
+    //! where the reduced auxiliary value goes, only for InterMap2DAllReduce()
+    AuxType* aux_result_;
+    ReduceFunction reduce_function_;
 };
 
 template <typename ValueType, typename Stack>
@@ -144,6 +211,14 @@ auto DIA<ValueType, Stack>::InterMap2D(const InterMapFunction& inter_map_functio
     return DIA<ValueType>(tlx::make_counting<InterMap2DNode>(*this, inter_map_function, line_element_num, up_lines, down_lines));
 }
 
+template <typename ValueType, typename Stack>
+template <typename InterMapFunction, typename AuxType, typename ReduceFunction>
+auto DIA<ValueType, Stack>::InterMap2DAllReduce(const InterMapFunction& inter_map_function, size_t line_element_num, size_t up_lines, size_t down_lines,
+                                                AuxType& aux_result, const ReduceFunction& reduce_function) const {
+    using InterMap2DNode = api::InterMap2DNode<ValueType,InterMapFunction,AuxType,ReduceFunction>;
+    return DIA<ValueType>(tlx::make_counting<InterMap2DNode>(*this, inter_map_function, line_element_num, up_lines, down_lines, &aux_result, reduce_function));
+}
+
 } // namespace api
 } // namespace thrill
 
@@ -14,17 +14,98 @@
 
 #include <thrill/api/dia.hpp>
 #include <thrill/api/dop_node.hpp>
+#include <thrill/api/stencil_halo.hpp>
+#include <thrill/common/cartesian_grid.hpp>
+#include <thrill/common/function_traits.hpp>
 #include <thrill/common/logger.hpp>
 #include <thrill/data/file.hpp>
 #include <thrill/data/block_writer.hpp>
 
+#include <tlx/die.hpp>
+
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <type_traits>
 #include <vector>
 
 namespace thrill {
 namespace api {
-    
+
+/*!
+ * Stencil2DNeighbors gives the stencil function of InterMap2D indexed access
+ * to the neighbours of one point of the worker's tile, read directly from the
+ * padded tile. at(dr, dc) is the point dr rows down and dc columns right of
+ * it. left(k) is the (k+1)-th point to the left, so left(0) is the adjacent
+ * one, and likewise for right(), up() and down().
+ *
+ * The counts are the configured halo widths, except at the border of the
+ * grid, where only the points inside the grid exist unless it is periodic
+ * there. The diagonal neighbours are only there if InterMap2D exchanges the
+ * corners.
+ */
+template <typename ValueType>
+class Stencil2DNeighbors
+{
+public:
+    using Halo = StencilHalo<ValueType, 2>;
+
+    explicit Stencil2DNeighbors(const Halo& halo)
+        : halo_(halo), row_stride_(halo.stride(0)) { }
+
+    //! whether at(dr, dc) exists
+    bool contains(ptrdiff_t dr, ptrdiff_t dc) const {
+        return halo_.Contains(pos_, { { dr, dc } });
+    }
+
+    const ValueType& at(ptrdiff_t dr, ptrdiff_t dc) const {
+        assert(contains(dr, dc));
+        return center_[dr * static_cast<ptrdiff_t>(row_stride_) + dc];
+    }
+
+    size_t left_count() const { return halo_.Count(pos_, 1, -1); }
+    size_t right_count() const { return halo_.Count(pos_, 1, +1); }
+    size_t up_count() const { return halo_.Count(pos_, 0, -1); }
+    size_t down_count() const { return halo_.Count(pos_, 0, +1); }
+
+    const ValueType& left(size_t k) const { return at(0, -1 - ptrdiff_t(k)); }
+    const ValueType& right(size_t k) const { return at(0, 1 + ptrdiff_t(k)); }
+    const ValueType& up(size_t k) const { return at(-1 - ptrdiff_t(k), 0); }
+    const ValueType& down(size_t k) const { return at(1 + ptrdiff_t(k), 0); }
+
+    //! row and column of the point in the worker's tile
+    size_t row() const { return pos_[0]; }
+    size_t column() const { return pos_[1]; }
+
+private:
+    template <typename, typename>
+    friend class InterMap2DNode;
+
+    const Halo& halo_;
+    size_t row_stride_;
+
+    //! current point and its position in the tile
+    const ValueType* center_ = nullptr;
+    typename Halo::Index pos_;
+};
+
 /*!
+ * InterMap2DNode runs a stencil function on each point of a rows x columns
+ * grid, which is split into tiles over the workers by a CartesianGrid, the same
+ * way as by Generate2D. The tiles must not be smaller than the halos. The
+ * workers exchange left_size, right_size, up_size and down_size columns and
+ * rows of their tiles with the neighbouring workers. With corners, the rows
+ * are exchanged first and then the columns together with the halo rows, so
+ * the diagonal neighbours are available as well. Along periodic rows or
+ * columns the exchange wraps around the grid of workers, and the points at
+ * one border of the grid see those at the other border as neighbours.
+ *
+ * The function is either f(value, neighbors) with a Stencil2DNeighbors, or
+ * f(value, left, right, up, down) with vectors of the neighbours, nearest
+ * first, which are filled anew for each point. It is called on the inner
+ * points of the tile while the halos are still under way and on the border
+ * band after they arrived, so it must not rely on the order of the points.
+ *
  * \ingroup api_layer
  */
 template <typename ValueType,typename InterMapFunction>
@@ -35,9 +116,10 @@ class InterMap2DNode final : public DOpNode<ValueType>
 public:
     using Super = DOpNode<ValueType>;
     using Super::context_;
+    using Halo = StencilHalo<ValueType, 2>;
  
     template <typename ParentDIA>
-    explicit InterMap2DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t left_size, size_t right_size, size_t up_size, size_t down_size)
+    explicit InterMap2DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t left_size, size_t right_size, size_t up_size, size_t down_size, bool corners, const std::array<bool, 2>& periodic)
         : Super(parent.ctx(), "InterMap2D", { parent.id() }, { parent.node() })
         ,parent_stack_empty_(ParentDIA::stack_empty),
         inter_map_function_(inter_map_function),
@@ -47,8 +129,10 @@ public:
         right_size_(right_size),
         up_size_(up_size),
         down_size_(down_size),
-        cat_stream_(parent.ctx().GetNewCatStream(this))
-        ,emitters_(cat_stream_->GetWriters()) 
+        // the same decomposition as Generate2D
+        halo_(common::CartesianGrid<2>({ { rows, columns } }, parent.ctx().num_workers()),
+              parent.ctx().my_rank(), { { up_size, left_size } },
+              { { down_size, right_size } }, corners, periodic)
         {
         auto pre_op_fn = [this](const ValueType& input) {
                            PreOp(input);
@@ -57,181 +141,86 @@ public:
         parent.node()->AddChild(this, lop_chain);
         my_rank_ = this->context().my_rank();
         total_rank_ = this->context().num_hosts() * this->context().workers_per_host();
-
     }
 
     void PreOp(const ValueType& input) {
-        values_.push_back(input);
+        halo_.push_back(input);
     }
 
     void StartPreOp(size_t parent_index) final {
     }
 
     void StopPreOp(size_t parent_index) final {
-        size_t size = values_.size();
-
-        size_t sub_rank = (int)sqrt(total_rank_);
-
-        size_t x_rank = my_rank_ / sub_rank;
-        size_t y_rank = my_rank_ % sub_rank;
-
-        size_t sub_rows = rows_ / sub_rank;
-        size_t sub_columns = columns_ / sub_rank;
- 
-
-        if(x_rank > 0){
-            for(size_t i = 0; i < down_size_ * sub_columns; i++){
-                std::pair<ValueType,int> item(values_[i],3);
-                emitters_[(x_rank-1)*sub_rank+y_rank].Put(item);
-            }            
- 
-        }
-        if(x_rank < sub_rank - 1){
-            for(size_t i = 0; i < up_size_ * sub_columns; i++){
-                
-                std::pair<ValueType,int> item(values_[values_.size() - up_size_ * sub_columns + i],2);
-                emitters_[(x_rank + 1) * sub_rank + y_rank].Put(item);
-            }
-
-        }
-        if(y_rank > 0){
-            for(size_t i = 0; i < right_size_; i++){
-                for(size_t j = 0; j < sub_rows; j++){
-                    std::pair<ValueType,int> item(values_[j * sub_columns + i],1);
-                    emitters_[x_rank * sub_rank + y_rank - 1].Put(item);
-                }
-            }
-        }
-        if(y_rank < sub_rank - 1){
-            for(size_t i = 0; i < left_size_; i++)
-                for(size_t j = 0; j< sub_rows; j++){
-
-                    std::pair<ValueType,int> item(values_[(j + 1) * sub_columns - i - 1],0);
-                    emitters_[x_rank * sub_rank + y_rank + 1].Put(item);
-            }
-        }
-
-
-        //emitters_.Close();
-        for (size_t i = 0; i < emitters_.size(); i++) {
-            emitters_[i].Flush();
-            emitters_[i].Close();
-        } 
-
-        context_.net.Barrier();
-        
-
+        // only send here, the halos arrive while Execute() computes the
+        // inner points
+        halo_.Post(context_.peer_channel(), this->dia_id());
     }
 
-    //! Executes the rebalance operation.
+    //! Computes the inner points, then waits for the halos and computes the
+    //! border band.
     void Execute() final {
-
-
+        Stencil2DNeighbors<ValueType> neighbors(halo_);
+        const ValueType* values = halo_.values().data();
+        results_.resize(halo_.TileSize());
+
+        auto compute = [&](const typename Halo::Index& pos, size_t index) {
+            neighbors.pos_ = pos;
+            neighbors.center_ = values + index;
+            results_[halo_.TileIndex(pos)] =
+                Apply(values[index], neighbors,
+                      std::integral_constant<
+                          bool, common::FunctionTraits<InterMapFunction>::arity == 2>());
+        };
+
+        halo_.ForEachInnerPoint(compute);
+        halo_.Finish(context_.peer_channel(), this->dia_id());
+        halo_.ForEachBorderPoint(compute);
+
+        halo_.Clear();
     }
 
-    void ProcessChannel(){
-
-    auto reader = cat_stream_ -> GetCatReader(true);
-
-        while(reader.HasNext()){
-            std::pair<ValueType,int> item = reader.template Next<std::pair<ValueType,int> >();
-            if(item.second == 0){
-                left_values_.push_back(item.first);
-            }else if(item.second == 1){
-                right_values_.push_back(item.first);
-            }else if(item.second == 2){
-                up_values_.push_back(item.first);
-            }else if(item.second == 3){
-                down_values_.push_back(item.first);
-            }
-        }
-    }
-
-
     void PushData(bool consume) final {
-
-        ProcessChannel();
-
-        std::vector<ValueType> results;
-
-        size_t sub_columns = columns_ / (int)sqrt(total_rank_);
-        size_t sub_rows = rows_ / (int)sqrt(total_rank_);
-        
-        for(size_t i=0;i<values_.size();i++){
-
-            std::vector<ValueType> left_neighbers;
-            if(left_values_.size() > 0 && i % sub_columns < left_size_){
-                for(size_t j = i % sub_columns; j < left_size_; j++){
-                    left_neighbers.push_back(left_values_[i / sub_columns * left_size_ + j]);
-                }
-            }
-            if(i % sub_columns > 0){
-                for(size_t j = 0; j < left_size_ && j < i % sub_columns; j++){
-                    left_neighbers.push_back(values_[i - left_size_ + j]);
-                }
-            }
-
-            std::vector<ValueType> right_neighbers;
-            if(right_values_.size() > 0 && sub_columns - 1 - (i % sub_columns) < right_size_){
-                for(size_t j = sub_columns - 1 - (i % sub_columns); j < right_size_; j++){
-                    right_neighbers.push_back(right_values_[i / sub_columns * right_size_ + j]);
-                }
-            }
-            if(sub_columns - 1 - (i % sub_columns) > 0){
-                for(size_t j = 0; j < right_size_ && j < sub_columns - 1 - (i % sub_columns) ; j++){
-                    right_neighbers.push_back(values_[i + right_size_ - j]);
-                }
-            }
-
-            std::vector<ValueType> up_neighbers;
-            if(up_values_.size() > 0 && i / sub_columns < up_size_){
-                for(size_t j = i / sub_columns; j < up_size_; j++){
-                    up_neighbers.push_back(up_values_[j * sub_columns + i % sub_columns]);
-                }
-            }
-            if(i / sub_columns > 0){
-                for(size_t j = 0; j < up_size_ && j < i / sub_columns; j++){
-                    up_neighbers.push_back(values_[i - (j+1) * sub_columns]);
-                }
-            }
-
-            std::vector<ValueType> down_neighbers;
-
- 
-            if(down_values_.size() > 0 && sub_rows - i / sub_columns <= down_size_){
-                for(size_t j = sub_rows - i / sub_columns - 1;j < down_size_; j++){
-                    down_neighbers.push_back(down_values_[j * sub_columns + i % sub_columns]);
-                }
-            }
-            if(sub_rows - i / sub_columns > 1){
-                for(size_t j = 0; j < down_size_ && j < sub_rows - i / sub_columns; j++){
-                    down_neighbers.push_back(values_[i + (j+1) * sub_columns]);
-                }
-            }
-            ValueType result = inter_map_function_(values_[i],left_neighbers, right_neighbers, up_neighbers, down_neighbers);
-            results.push_back(result);
-        }
-        
-        typename std::vector<ValueType>::iterator itr = results.begin();
-
-        for(; itr!=results.end();++itr)
-        { 
-            this->PushItem(*itr);
-        }
+        for (const ValueType& result : results_)
+            this->PushItem(result);
+        if (consume)
+            std::vector<ValueType>().swap(results_);
     }
 
     void Dispose() final {
+        halo_.Clear();
+        std::vector<ValueType>().swap(results_);
     }
 
 private:
+    //! Calls the function with the neighbour accessor.
+    ValueType Apply(const ValueType& value, const Stencil2DNeighbors<ValueType>& neighbors,
+                    std::true_type /* accessor */) {
+        return inter_map_function_(value, neighbors);
+    }
+
+    //! Calls the function with the neighbours copied into the reused vectors.
+    ValueType Apply(const ValueType& value, const Stencil2DNeighbors<ValueType>& neighbors,
+                    std::false_type /* accessor */) {
+        left_neighbors_.clear(), right_neighbors_.clear();
+        up_neighbors_.clear(), down_neighbors_.clear();
+        for(size_t k = 0; k < neighbors.left_count(); k++)
+            left_neighbors_.push_back(neighbors.left(k));
+        for(size_t k = 0; k < neighbors.right_count(); k++)
+            right_neighbors_.push_back(neighbors.right(k));
+        for(size_t k = 0; k < neighbors.up_count(); k++)
+            up_neighbors_.push_back(neighbors.up(k));
+        for(size_t k = 0; k < neighbors.down_count(); k++)
+            down_neighbors_.push_back(neighbors.down(k));
+        return inter_map_function_(value, left_neighbors_, right_neighbors_,
+                                   up_neighbors_, down_neighbors_);
+    }
+
     //! Whether the parent stack is empty
     const bool parent_stack_empty_;
 
-    std::vector<ValueType> values_;
-    std::vector<ValueType> up_values_;
-    std::vector<ValueType> down_values_;
-    std::vector<ValueType> left_values_;
-    std::vector<ValueType> right_values_;
+    //! neighbours of the point for the function on vectors
+    std::vector<ValueType> left_neighbors_, right_neighbors_;
+    std::vector<ValueType> up_neighbors_, down_neighbors_;
 
     size_t my_rank_;
     size_t total_rank_;
@@ -243,17 +232,19 @@ private:
     size_t left_size_;
     size_t right_size_;
 
-    //data::MixStreamPtr mix_stream_;
-    data::CatStreamPtr cat_stream_;
-    data::CatStream::Writers emitters_;
     InterMapFunction inter_map_function_;
+
+    //! the worker's tile with the halo rows and columns around it
+    Halo halo_;
+    //! the new values of the tile, in its order
+    std::vector<ValueType> results_;
 };
 
 template <typename ValueType, typename Stack>
 template <typename InterMapFunction>
-auto DIA<ValueType, Stack>::InterMap2D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t left_size, size_t right_size, size_t up_size, size_t down_size) const {
+auto DIA<ValueType, Stack>::InterMap2D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t left_size, size_t right_size, size_t up_size, size_t down_size, bool corners, const std::array<bool, 2>& periodic) const {
     using InterMap2DNode = api::InterMap2DNode<ValueType,InterMapFunction>;
-    return DIA<ValueType>(tlx::make_counting<InterMap2DNode>(*this, inter_map_function, rows, columns, left_size, right_size, up_size, down_size));
+    return DIA<ValueType>(tlx::make_counting<InterMap2DNode>(*this, inter_map_function, rows, columns, left_size, right_size, up_size, down_size, corners, periodic));
 }
 
 } // namespace api
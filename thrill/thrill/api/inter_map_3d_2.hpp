@@ -14,17 +14,102 @@
 
 #include <thrill/api/dia.hpp>
 #include <thrill/api/dop_node.hpp>
+#include <thrill/api/stencil_halo.hpp>
+#include <thrill/common/cartesian_grid.hpp>
+#include <thrill/common/function_traits.hpp>
 #include <thrill/common/logger.hpp>
 #include <thrill/data/file.hpp>
 #include <thrill/data/block_writer.hpp>
 
+#include <tlx/die.hpp>
+
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <type_traits>
 #include <vector>
 
 namespace thrill {
 namespace api {
-    
+
+/*!
+ * Stencil3DNeighbors gives the stencil function of InterMap3D indexed access
+ * to the neighbours of one point of the worker's tile, read directly from the
+ * padded tile. at(dr, dc, dl) is the point dr rows down, dc columns right and
+ * dl layers to the front of it. left(k) is the (k+1)-th point to the left, so
+ * left(0) is the adjacent one, and likewise for right(), up(), down(),
+ * front() and back().
+ *
+ * As for Stencil2DNeighbors, the counts are the halo widths except at the
+ * border of the grid unless it is periodic there, and the edge and corner neighbours are only there if
+ * InterMap3D exchanges the corners.
+ */
+template <typename ValueType>
+class Stencil3DNeighbors
+{
+public:
+    using Halo = StencilHalo<ValueType, 3>;
+
+    explicit Stencil3DNeighbors(const Halo& halo)
+        : halo_(halo),
+          layer_stride_(halo.stride(0)), row_stride_(halo.stride(1)) { }
+
+    //! whether at(dr, dc, dl) exists
+    bool contains(ptrdiff_t dr, ptrdiff_t dc, ptrdiff_t dl) const {
+        return halo_.Contains(pos_, { { dl, dr, dc } });
+    }
+
+    const ValueType& at(ptrdiff_t dr, ptrdiff_t dc, ptrdiff_t dl) const {
+        assert(contains(dr, dc, dl));
+        return center_[dl * static_cast<ptrdiff_t>(layer_stride_) +
+                       dr * static_cast<ptrdiff_t>(row_stride_) + dc];
+    }
+
+    size_t left_count() const { return halo_.Count(pos_, 2, -1); }
+    size_t right_count() const { return halo_.Count(pos_, 2, +1); }
+    size_t up_count() const { return halo_.Count(pos_, 1, -1); }
+    size_t down_count() const { return halo_.Count(pos_, 1, +1); }
+    size_t front_count() const { return halo_.Count(pos_, 0, +1); }
+    size_t back_count() const { return halo_.Count(pos_, 0, -1); }
+
+    const ValueType& left(size_t k) const { return at(0, -1 - ptrdiff_t(k), 0); }
+    const ValueType& right(size_t k) const { return at(0, 1 + ptrdiff_t(k), 0); }
+    const ValueType& up(size_t k) const { return at(-1 - ptrdiff_t(k), 0, 0); }
+    const ValueType& down(size_t k) const { return at(1 + ptrdiff_t(k), 0, 0); }
+    const ValueType& front(size_t k) const { return at(0, 0, 1 + ptrdiff_t(k)); }
+    const ValueType& back(size_t k) const { return at(0, 0, -1 - ptrdiff_t(k)); }
+
+    //! row, column and layer of the point in the worker's tile
+    size_t row() const { return pos_[1]; }
+    size_t column() const { return pos_[2]; }
+    size_t layer() const { return pos_[0]; }
+
+private:
+    template <typename, typename>
+    friend class InterMap3DNode;
+
+    const Halo& halo_;
+    size_t layer_stride_, row_stride_;
+
+    //! current point and its position (layer, row, column) in the tile
+    const ValueType* center_ = nullptr;
+    typename Halo::Index pos_;
+};
+
 /*!
+ * InterMap3DNode runs a stencil function on each point of a layers x rows x
+ * columns grid, which is split into tiles over the workers by a CartesianGrid,
+ * the same way as by Generate3D. The tiles must not be smaller than the halos.
+ * With corners, the layers, rows and columns are exchanged one after the
+ * other, so the edge and corner neighbours of 27-point stencils arrive as
+ * well. periodic marks the rows, columns and layers along which the grid
+ * wraps around.
+ *
+ * The function is either f(value, neighbors) with a Stencil3DNeighbors, or
+ * f(value, left, right, up, down, front, back) with vectors of the
+ * neighbours, nearest first, which are filled anew for each point. As in
+ * InterMap2D, the inner points are computed while the halos are under way.
+ *
  * \ingroup api_layer
  */
 template <typename ValueType,typename InterMapFunction>
@@ -35,9 +120,10 @@ class InterMap3DNode final : public DOpNode<ValueType>
 public:
     using Super = DOpNode<ValueType>;
     using Super::context_;
+    using Halo = StencilHalo<ValueType, 3>;
  
     template <typename ParentDIA>
-    explicit InterMap3DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t layers, size_t left_size, size_t right_size, size_t up_size, size_t down_size, size_t front_size, size_t back_size)
+    explicit InterMap3DNode(const ParentDIA& parent, const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t layers, size_t left_size, size_t right_size, size_t up_size, size_t down_size, size_t front_size, size_t back_size, bool corners, const std::array<bool, 3>& periodic)
         : Super(parent.ctx(), "InterMap3D", { parent.id() }, { parent.node() })
         ,parent_stack_empty_(ParentDIA::stack_empty),
         inter_map_function_(inter_map_function),
@@ -50,8 +136,12 @@ public:
         down_size_(down_size),
         front_size_(front_size),
         back_size_(back_size),
-        cat_stream_(parent.ctx().GetNewCatStream(this))
-        ,emitters_(cat_stream_->GetWriters()) 
+        // the same decomposition as Generate3D, the layers are the slowest
+        // dimension of the worker grid and the columns the fastest
+        halo_(common::CartesianGrid<3>({ { layers, rows, columns } }, parent.ctx().num_workers()),
+              parent.ctx().my_rank(), { { back_size, up_size, left_size } },
+              { { front_size, down_size, right_size } }, corners,
+              { { periodic[2], periodic[0], periodic[1] } })
         {
         auto pre_op_fn = [this](const ValueType& input) {
                            PreOp(input);
@@ -60,274 +150,93 @@ public:
         parent.node()->AddChild(this, lop_chain);
         my_rank_ = this->context().my_rank();
         total_rank_ = this->context().num_hosts() * this->context().workers_per_host();
-
     }
 
     void PreOp(const ValueType& input) {
-        values_.push_back(input);
+        halo_.push_back(input);
     }
 
     void StartPreOp(size_t parent_index) final {
     }
 
     void StopPreOp(size_t parent_index) final {
-        size_t size = values_.size();
-
-        size_t sub_rank = (int)pow(total_rank_, 1.0/3);
-        std::cout << "sub_rank = " << sub_rank << std::endl;
-
-        size_t x_rank = (my_rank_ % (sub_rank * sub_rank)) / sub_rank;
-        size_t y_rank = (my_rank_ % (sub_rank * sub_rank)) % sub_rank;
-        size_t z_rank = my_rank_ / (sub_rank * sub_rank); 
-
-        size_t sub_rows = rows_ / sub_rank;
-        size_t sub_columns = columns_ / sub_rank;
-        size_t sub_layers = layers_ / sub_rank; 
-
-        std::cout << "sub_rows=" << sub_rows << " sub_columns=" << sub_columns << " sub_layers=" << sub_layers << std::endl;
-
-        std::cout << "left_size=" << left_size_ << " right_size=" << right_size_ << " up_size=" << up_size_ << " down_size=" << down_size_ << " front_size=" << front_size_ << " back_size=" << back_size_ << std::endl;
-
-        if(x_rank > 0){
-            for(size_t j = 0; j < sub_layers; j++){
-            for(size_t i = 0; i < down_size_ * sub_columns; i++){
-                std::pair<ValueType,int> item(values_[j * sub_rows * sub_columns + i],3);
-                emitters_[z_rank * sub_rank * sub_rank + (x_rank-1) * sub_rank + y_rank].Put(item);
-            }
-            }            
- 
-        }
-        if(x_rank < sub_rank - 1){
-            for(size_t j = 0; j < sub_layers; j++){
-            for(size_t i = 0; i < up_size_ * sub_columns; i++){
-                std::pair<ValueType,int> item(values_[sub_rows * sub_columns * (j + 1) - up_size_ * sub_columns + i],2);
-                emitters_[z_rank * sub_rank * sub_rank + (x_rank + 1) * sub_rank + y_rank].Put(item);
-                }
-            }
-
-        }
-        if(y_rank > 0){
-            for(size_t k = 0; k < sub_layers;k++){
-            for(size_t i = 0; i < right_size_; i++){
-                for(size_t j = 0; j < sub_rows; j++){
-                    std::pair<ValueType,int> item(values_[k * sub_rows * sub_columns + j * sub_columns + i],1);
-                    emitters_[z_rank * sub_rank * sub_rank + x_rank * sub_rank + y_rank - 1].Put(item);
-                }
-            }
-            }
-        }
-        if(y_rank < sub_rank - 1){
-            for(size_t k = 0; k < sub_layers; k++){
-            for(size_t i = 0; i < left_size_; i++){
-                for(size_t j = 0; j< sub_rows; j++){
-
-                    std::pair<ValueType,int> item(values_[k * sub_rows * sub_columns + (j + 1) * sub_columns - i - 1],0);
-                    emitters_[z_rank * sub_rank * sub_rank + x_rank * sub_rank + y_rank + 1].Put(item);
-                }
-            }
-            }
-        }
-        if(z_rank > 0){
-            for(size_t i = 0; i < front_size_; i++){
-                for(size_t j = 0; j < sub_rows; j++){
-                    for(size_t k = 0; k < sub_columns; k++){
-                        std::pair<ValueType,int> item(values_[i * sub_rows * sub_columns + j * sub_columns + k],4);
-                        emitters_[(z_rank - 1) * sub_rank * sub_rank + x_rank * sub_rank + y_rank].Put(item);
-                    }
-                }
- 
-            }
-        }
-
-        if(z_rank < sub_rank -1){
-            for(size_t i=0; i < back_size_; i++){
-                for(size_t j = 0; j < sub_rows; j++){
-                    for(size_t k = 0; k < sub_columns; k++){
-                        std::pair<ValueType,int> item(values_[(sub_layers - i - 1) * sub_rows * sub_columns + j * sub_columns + k],5);
-                        emitters_[(z_rank + 1) * sub_rank * sub_rank + x_rank * sub_rank + y_rank].Put(item);
-                    }
-                }
-            }
-        }
-
-        for (size_t i = 0; i < emitters_.size(); i++) {
-            emitters_[i].Flush();
-            emitters_[i].Close();
-        } 
-
-        context_.net.Barrier();
-        
-
+        // only send here, the halos arrive while Execute() computes the
+        // inner points
+        halo_.Post(context_.peer_channel(), this->dia_id());
     }
 
-    //! Executes the rebalance operation.
+    //! Computes the inner points, then waits for the halos and computes the
+    //! border band.
     void Execute() final {
-
-
-    }
-
-    void ProcessChannel(){
-
-    auto reader = cat_stream_ -> GetCatReader(true);
-
-        while(reader.HasNext()){
-            std::pair<ValueType,int> item = reader.template Next<std::pair<ValueType,int> >();
-            if(item.second == 0){
-                left_values_.push_back(item.first);
-            }else if(item.second == 1){
-                right_values_.push_back(item.first);
-            }else if(item.second == 2){
-                up_values_.push_back(item.first);
-            }else if(item.second == 3){
-                down_values_.push_back(item.first);
-            }else if(item.second == 4){
-                front_values_.push_back(item.first);
-            }else if(item.second == 5){
-                back_values_.push_back(item.first);
-            }
-        }
-
+        Stencil3DNeighbors<ValueType> neighbors(halo_);
+        const ValueType* values = halo_.values().data();
+        results_.resize(halo_.TileSize());
+
+        auto compute = [&](const typename Halo::Index& pos, size_t index) {
+            neighbors.pos_ = pos;
+            neighbors.center_ = values + index;
+            results_[halo_.TileIndex(pos)] =
+                Apply(values[index], neighbors,
+                      std::integral_constant<
+                          bool, common::FunctionTraits<InterMapFunction>::arity == 2>());
+        };
+
+        halo_.ForEachInnerPoint(compute);
+        halo_.Finish(context_.peer_channel(), this->dia_id());
+        halo_.ForEachBorderPoint(compute);
+
+        halo_.Clear();
     }
 
-
     void PushData(bool consume) final {
-
-        ProcessChannel();
-
-        std::vector<ValueType> results;
-
-        size_t sub_rank = (int)pow(total_rank_, 1.0/3);
-        size_t sub_rows = rows_ / sub_rank;
-        size_t sub_columns = columns_ / sub_rank;
-        size_t sub_layers = layers_ / sub_rank;
- 
-        for(size_t i=0;i<values_.size();i++){
-
-            std::vector<ValueType> left_neighbers;
-            if(i % sub_columns > 0){
-                for(size_t j = 0; j < left_size_ && j < i % sub_columns; j++){
-                    left_neighbers.push_back(values_[i - j - 1]);
-                }
-            }
-            if(left_values_.size() > 0 && i % sub_columns  < left_size_){
-                for(size_t j = 0; j < left_size_ - i % sub_columns; j++){
-                    left_neighbers.push_back(left_values_[(i / (sub_rows * sub_columns)) * left_size_ * sub_rows + (i % (sub_columns * sub_rows)) / sub_columns + j * sub_rows]);
-                }
-            }
-           
-            std::vector<ValueType> right_neighbers;
-            if(sub_columns - 1 - (i % sub_columns) > 0){
-                for(size_t j = 0; j < right_size_ && j < sub_columns - 1 - (i % sub_columns) ; j++){
-                    right_neighbers.push_back(values_[i + j + 1]);
-                }
-            }
-            if(right_values_.size() > 0 && sub_columns - 1 - (i % sub_columns) < right_size_){
-                for(size_t j = 0; j < right_size_-(sub_columns - 1 - (i % sub_columns)); j++){
-                    right_neighbers.push_back(right_values_[(i / (sub_rows * sub_columns)) * right_size_ * sub_rows + (i % (sub_columns * sub_rows))/ sub_columns + j * sub_rows]);
-                }
-            }
-
-            std::vector<ValueType> up_neighbers;
-            if((i % (sub_columns * sub_rows))/ sub_columns > 0){
-                for(size_t j = 0; j < up_size_ && j < (i % (sub_columns * sub_rows)) / sub_columns; j++){
-                    up_neighbers.push_back(values_[i - (j+1) * sub_columns]);
-                }
-            }
-
-            if(up_values_.size() > 0 && (i % (sub_columns * sub_rows))/ sub_columns < up_size_){
-                for(size_t j = (i % (sub_columns * sub_rows))/ sub_columns; j < up_size_; j++){
-                    up_neighbers.push_back(up_values_[i / (sub_rows * sub_columns) * up_size_ * sub_columns + (i % sub_columns) + j * sub_columns]);
-                }
-            }
-
-            std::vector<ValueType> down_neighbers;
-            if(sub_rows - (i % (sub_columns * sub_rows)) / sub_columns > 1){
-                for(size_t j = 0; j < down_size_ && j < sub_rows - (i % (sub_columns * sub_rows)) / sub_columns - 1; j++){
-                    down_neighbers.push_back(values_[i + (j+1) * sub_columns]);
-                }
-            }
-            if(down_values_.size() > 0 && sub_rows - (i % (sub_columns * sub_rows)) / sub_columns <= down_size_){
-                for(size_t j = 0; j < down_size_ - (sub_rows - (i % (sub_columns * sub_rows)) / sub_columns - 1); j++){
-                    down_neighbers.push_back(down_values_[i / (sub_rows * sub_columns) * down_size_ * sub_columns + (i % sub_columns) + j * sub_columns]);
-                }
-            }
-            
-            std::vector<ValueType> front_neighbers;
-            if(sub_layers - i / (sub_columns * sub_rows) > 1){
-                for(size_t j = 0; j < front_size_ && j < sub_layers - i / (sub_columns * sub_rows) - 1; j++){
-                    front_neighbers.push_back(values_[i + (j + 1) * sub_columns * sub_rows]);
-                }
-            }
-            if(front_values_.size() > 0 && sub_layers - i / (sub_rows * sub_columns) - 1 < front_size_){
-                for(size_t j = 0; j < front_size_ - (sub_layers - i / (sub_rows * sub_columns) - 1); j++){
-                    front_neighbers.push_back(front_values_[j * sub_columns * sub_rows + i % (sub_columns * sub_rows)]);
-                }
-            }
-            
-            std::vector<ValueType> back_neighbers;
-            if(i / (sub_columns * sub_rows) > 0){
-                for(size_t j = 0; j < back_size_ && j < i / (sub_columns * sub_rows); j++){
-                    back_neighbers.push_back(values_[i - (j+1) * sub_columns * sub_rows]);
-                }
-            }
-            if(back_values_.size() > 0 && i / (sub_rows * sub_columns) < back_size_){
-                for(size_t j = 0; j < back_size_ - (i / (sub_columns * sub_rows)); j++){
-                    back_neighbers.push_back(back_values_[j * sub_columns * sub_rows + i % (sub_columns * sub_rows)]);
-                }
-            }
-            
-            std::cout << "value:" << values_[i] << " left_neighbers:";
-            for(size_t y = 0;y < left_neighbers.size();y++){
-                std::cout << left_neighbers[y] << " ";
-            }
-            std::cout << "right_neighbers:";
-            for(size_t y = 0;y < right_neighbers.size();y++){
-                std::cout << right_neighbers[y] << " ";
-            }
-            std::cout << "up_neighbers:";
-            for(size_t y = 0;y < up_neighbers.size();y++){
-                std::cout << up_neighbers[y] << " ";
-            }
-             std::cout << "down_neighbers:";
-            for(size_t y = 0;y < down_neighbers.size();y++){
-                std::cout << down_neighbers[y] << " ";
-            }
-             std::cout << "front_neighbers:";
-            for(size_t y = 0;y < front_neighbers.size();y++){
-                std::cout << front_neighbers[y] << " ";
-            }
-              std::cout << "back_neighbers:";
-            for(size_t y = 0;y < back_neighbers.size();y++){
-                std::cout << back_neighbers[y] << " ";
-            }
-                std::cout << std::endl;
- 
-            ValueType result = inter_map_function_(values_[i],left_neighbers, right_neighbers, up_neighbers, down_neighbers, front_neighbers, back_neighbers);
-            results.push_back(result);
-        }
-        
-        typename std::vector<ValueType>::iterator itr = results.begin();
-
-        for(; itr!=results.end();++itr)
-        { 
-            this->PushItem(*itr);
-        }
+        for (const ValueType& result : results_)
+            this->PushItem(result);
+        if (consume)
+            std::vector<ValueType>().swap(results_);
     }
 
     void Dispose() final {
+        halo_.Clear();
+        std::vector<ValueType>().swap(results_);
     }
 
 private:
+    //! Calls the function with the neighbour accessor.
+    ValueType Apply(const ValueType& value, const Stencil3DNeighbors<ValueType>& neighbors,
+                    std::true_type /* accessor */) {
+        return inter_map_function_(value, neighbors);
+    }
+
+    //! Calls the function with the neighbours copied into the reused vectors.
+    ValueType Apply(const ValueType& value, const Stencil3DNeighbors<ValueType>& neighbors,
+                    std::false_type /* accessor */) {
+        left_neighbors_.clear(), right_neighbors_.clear();
+        up_neighbors_.clear(), down_neighbors_.clear();
+        front_neighbors_.clear(), back_neighbors_.clear();
+        for(size_t k = 0; k < neighbors.left_count(); k++)
+            left_neighbors_.push_back(neighbors.left(k));
+        for(size_t k = 0; k < neighbors.right_count(); k++)
+            right_neighbors_.push_back(neighbors.right(k));
+        for(size_t k = 0; k < neighbors.up_count(); k++)
+            up_neighbors_.push_back(neighbors.up(k));
+        for(size_t k = 0; k < neighbors.down_count(); k++)
+            down_neighbors_.push_back(neighbors.down(k));
+        for(size_t k = 0; k < neighbors.front_count(); k++)
+            front_neighbors_.push_back(neighbors.front(k));
+        for(size_t k = 0; k < neighbors.back_count(); k++)
+            back_neighbors_.push_back(neighbors.back(k));
+        return inter_map_function_(value, left_neighbors_, right_neighbors_,
+                                   up_neighbors_, down_neighbors_,
+                                   front_neighbors_, back_neighbors_);
+    }
+
     //! Whether the parent stack is empty
     const bool parent_stack_empty_;
 
-    std::vector<ValueType> values_;
-    std::vector<ValueType> up_values_;
-    std::vector<ValueType> down_values_;
-    std::vector<ValueType> left_values_;
-    std::vector<ValueType> right_values_;
-    std::vector<ValueType> front_values_;
-    std::vector<ValueType> back_values_;
+    //! neighbours of the point for the function on vectors
+    std::vector<ValueType> left_neighbors_, right_neighbors_;
+    std::vector<ValueType> up_neighbors_, down_neighbors_;
+    std::vector<ValueType> front_neighbors_, back_neighbors_;
 
     size_t my_rank_;
     size_t total_rank_;
@@ -342,17 +251,19 @@ private:
     size_t front_size_;
     size_t back_size_;
 
-    //data::MixStreamPtr mix_stream_;
-    data::CatStreamPtr cat_stream_;
-    data::CatStream::Writers emitters_;
     InterMapFunction inter_map_function_;
+
+    //! the worker's tile with the halo layers, rows and columns around it
+    Halo halo_;
+    //! the new values of the tile, in its order
+    std::vector<ValueType> results_;
 };
 
 template <typename ValueType, typename Stack>
 template <typename InterMapFunction>
-auto DIA<ValueType, Stack>::InterMap3D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t layers, size_t left_size, size_t right_size, size_t up_size, size_t down_size, size_t front_size, size_t back_size) const {
+auto DIA<ValueType, Stack>::InterMap3D(const InterMapFunction& inter_map_function, size_t rows, size_t columns, size_t layers, size_t left_size, size_t right_size, size_t up_size, size_t down_size, size_t front_size, size_t back_size, bool corners, const std::array<bool, 3>& periodic) const {
     using InterMap3DNode = api::InterMap3DNode<ValueType,InterMapFunction>;
-    return DIA<ValueType>(tlx::make_counting<InterMap3DNode>(*this, inter_map_function, rows, columns, layers, left_size, right_size, up_size, down_size, front_size, back_size));
+    return DIA<ValueType>(tlx::make_counting<InterMap3DNode>(*this, inter_map_function, rows, columns, layers, left_size, right_size, up_size, down_size, front_size, back_size, corners, periodic));
 }
 
 } // namespace api
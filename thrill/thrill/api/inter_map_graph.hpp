@@ -0,0 +1,453 @@
+/*******************************************************************************
+ * thrill/api/inter_map_graph.hpp
+ *
+ * DIANode for an iterated map over the vertices of a general sparse graph:
+ * each worker holds a contiguous block of vertex ids and, in each iteration,
+ * receives the values of the ghost vertices its vertices are connected to. The
+ * ghost lists are computed once, before the first iteration.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_API_INTER_MAP_GRAPH_HEADER
+#define THRILL_API_INTER_MAP_GRAPH_HEADER
+
+#include <thrill/api/dia.hpp>
+#include <thrill/api/dop_node.hpp>
+#include <thrill/common/functional.hpp>
+#include <thrill/common/logger.hpp>
+#include <thrill/common/math.hpp>
+#include <thrill/data/cat_stream.hpp>
+#include <thrill/net/flow_control_channel.hpp>
+
+#include <tlx/die.hpp>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace thrill {
+namespace api {
+
+/*!
+ * Values of the vertices a worker's iteration function may read: the value of
+ * each local vertex and of each ghost vertex as published before the current
+ * iteration. The neighbours of the local vertices are resolved to value slots
+ * once, so a lookup is a plain index.
+ */
+template <typename HaloType>
+class GraphHalo
+{
+public:
+    //! number of local vertices
+    size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+
+    //! global id of the first local vertex, local vertex i has id begin() + i
+    size_t begin() const { return begin_; }
+
+    //! number of neighbours of local vertex i
+    size_t degree(size_t i) const { return offsets_[i + 1] - offsets_[i]; }
+
+    //! value of the k-th neighbour of local vertex i, in the order returned
+    //! by the neighbours function
+    const HaloType& neighbor(size_t i, size_t k) const {
+        return values_[slots_[offsets_[i] + k]];
+    }
+
+    //! value of local vertex i
+    const HaloType& self(size_t i) const { return values_[i]; }
+
+    //! number of ghost vertices
+    size_t ghosts() const { return values_.size() - size(); }
+
+private:
+    template <typename, typename, typename, typename, typename, typename>
+    friend class InterMapGraphNode;
+
+    size_t begin_ = 0;
+    //! values of the local vertices, followed by the ghost vertices
+    std::vector<HaloType> values_;
+    //! neighbours of local vertex i are slots_[offsets_[i]..offsets_[i+1])
+    std::vector<size_t> offsets_, slots_;
+};
+
+/*!
+ * InterMapGraphNode first moves each item to the worker owning its vertex id:
+ * the ids must be 0..n-1, and worker p owns the range CalculateLocalRange(n,
+ * p). It then asks neighbors_function for the neighbour ids of each local
+ * vertex and sets up the ghost lists: which values each worker receives from
+ * and sends to every other worker.
+ *
+ * Each iteration, publish_function turns every local item into the value its
+ * neighbours see. The values of the ghost vertices are exchanged and
+ * iterate_function(items, halo) updates the local items, which are sorted by
+ * id, and returns the local residual. Only the ghost values are sent: with
+ * Predecessor() and Successor() if all ghosts of all workers live on the
+ * neighbouring workers, as for grids numbered row by row, else over the
+ * Context's PeerChannel, which carries each worker's values only to the
+ * workers that have them as ghosts without synchronizing the others.
+ *
+ * Every check_interval iterations the residuals of all workers are summed up
+ * and passed to the convergence predicate, all workers leave the loop together
+ * once it returns true. The resulting DIA holds the items sorted by id.
+ *
+ * \ingroup api_layer
+ */
+template <typename ValueType, typename IdFunction, typename NeighborsFunction,
+          typename PublishFunction, typename IterateFunction,
+          typename ConvergedFunction>
+class InterMapGraphNode final : public DOpNode<ValueType>
+{
+    static constexpr bool debug = false;
+
+public:
+    using Super = DOpNode<ValueType>;
+    using Super::context_;
+
+    using HaloType = typename std::decay<
+              typename common::FunctionTraits<PublishFunction>::result_type>::type;
+
+    template <typename ParentDIA>
+    InterMapGraphNode(const ParentDIA& parent,
+                      const IdFunction& id_function,
+                      const NeighborsFunction& neighbors_function,
+                      const PublishFunction& publish_function,
+                      const IterateFunction& iterate_function,
+                      size_t max_iterations,
+                      const ConvergedFunction& converged_function,
+                      size_t check_interval)
+        : Super(parent.ctx(), "InterMapGraph",
+                { parent.id() }, { parent.node() }),
+          id_function_(id_function),
+          neighbors_function_(neighbors_function),
+          publish_function_(publish_function),
+          iterate_function_(iterate_function),
+          converged_function_(converged_function),
+          max_iterations_(max_iterations),
+          check_interval_(check_interval) {
+        auto pre_op_fn = [this](const ValueType& input) {
+                             items_.push_back(input);
+                         };
+        auto lop_chain = parent.stack().push(pre_op_fn).fold();
+        parent.node()->AddChild(this, lop_chain);
+    }
+
+    //! Distributes the items, sets up the ghost lists and runs all
+    //! iterations.
+    void Execute() final {
+        Distribute();
+        SetupGhosts();
+
+        size_t iter = 0;
+        while (iter < max_iterations_) {
+            ExchangeGhosts();
+
+            double residual = iterate_function_(items_, halo_);
+            ++iter;
+
+            if (check_interval_ != 0 && iter % check_interval_ == 0) {
+                double global_residual = context_.net.AllReduce(residual);
+                LOG << "InterMapGraph() iteration " << iter
+                    << " residual " << global_residual;
+                if (converged_function_(global_residual, iter)) break;
+            }
+        }
+    }
+
+    void PushData(bool consume) final {
+        for (const ValueType& item : items_) this->PushItem(item);
+        if (consume) Dispose();
+    }
+
+    void Dispose() final {
+        std::vector<ValueType>().swap(items_);
+        halo_ = GraphHalo<HaloType>();
+        std::vector<std::vector<size_t> >().swap(send_lists_);
+        std::vector<size_t>().swap(send_targets_);
+    }
+
+private:
+    IdFunction id_function_;
+    NeighborsFunction neighbors_function_;
+    PublishFunction publish_function_;
+    IterateFunction iterate_function_;
+    ConvergedFunction converged_function_;
+
+    size_t max_iterations_;
+    size_t check_interval_;
+
+    //! number of vertices over all workers
+    size_t global_size_ = 0;
+    //! local items, sorted by id after Distribute()
+    std::vector<ValueType> items_;
+    GraphHalo<HaloType> halo_;
+    //! local indexes of the values sent to each worker in every iteration
+    std::vector<std::vector<size_t> > send_lists_;
+    //! workers owning ghosts of this one, in ascending order
+    std::vector<size_t> ghost_sources_;
+    //! workers having ghosts owned by this one, in ascending order
+    std::vector<size_t> send_targets_;
+
+    //! whether all ghosts live on the neighbouring workers
+    bool neighbour_only_ = true;
+    //! largest number of values any worker sends to the previous and to the
+    //! next worker
+    size_t count_prev_ = 0, count_next_ = 0;
+    //! number of ghosts owned by the previous worker
+    size_t ghosts_prev_ = 0;
+
+    //! Moves each item to the worker owning its id and sorts the local ones.
+    void Distribute() {
+        global_size_ = context_.net.AllReduce(items_.size());
+        const size_t num_workers = context_.num_workers();
+
+        // the rows move once, each straight to its owner
+        std::vector<ValueType> local;
+        std::vector<size_t> sources(num_workers);
+        for (size_t p = 0; p < num_workers; ++p) sources[p] = p;
+        SendReceive(
+            [&](data::CatStream::Writers& writers) {
+                for (const ValueType& item : items_) {
+                    size_t id = id_function_(item);
+                    if (id >= global_size_)
+                        die("InterMapGraph: vertex id " << id << " out of range, "
+                            "ids must be 0.." << global_size_ - 1);
+                    writers[common::CalculatePartition(
+                                global_size_, num_workers, id)].Put(item);
+                }
+                std::vector<ValueType>().swap(items_);
+            },
+            sources,
+            [&](size_t /* p */, auto& reader) {
+                while (reader.HasNext())
+                    local.push_back(reader.template Next<ValueType>());
+            });
+        items_.swap(local);
+
+        std::sort(items_.begin(), items_.end(),
+                  [this](const ValueType& a, const ValueType& b) {
+                      return id_function_(a) < id_function_(b);
+                  });
+
+        common::Range range = context_.CalculateLocalRange(global_size_);
+        bool contiguous = items_.size() == range.size();
+        for (size_t i = 0; contiguous && i < items_.size(); ++i)
+            contiguous = id_function_(items_[i]) == range.begin + i;
+        if (!contiguous)
+            die("InterMapGraph: vertex ids must be 0.." << global_size_ - 1
+                << " without gaps or duplicates");
+
+        halo_.begin_ = range.begin;
+        sLOG << "InterMapGraph: local range" << range;
+    }
+
+    //! Resolves the neighbours of all local vertices to value slots and tells
+    //! the owners of the ghost vertices which values to send.
+    void SetupGhosts() {
+        const size_t num_workers = context_.num_workers();
+        const size_t my_rank = context_.my_rank();
+        const size_t n = items_.size();
+        const size_t begin = halo_.begin_;
+
+        // ghost ids wanted from each worker, sorted and unique
+        std::vector<std::vector<size_t> > wanted(num_workers);
+        for (const ValueType& item : items_) {
+            for (const size_t& id : neighbors_function_(item)) {
+                if (id >= global_size_)
+                    die("InterMapGraph: neighbour id " << id << " out of range");
+                if (id >= begin && id < begin + n) continue;
+                wanted[common::CalculatePartition(
+                           global_size_, num_workers, id)].push_back(id);
+            }
+        }
+        std::vector<size_t> ghost_offset(num_workers + 1, n);
+        for (size_t p = 0; p < num_workers; ++p) {
+            std::sort(wanted[p].begin(), wanted[p].end());
+            wanted[p].erase(std::unique(wanted[p].begin(), wanted[p].end()),
+                            wanted[p].end());
+            ghost_offset[p + 1] = ghost_offset[p] + wanted[p].size();
+        }
+
+        // value slot of each neighbour
+        halo_.offsets_.assign(1, 0);
+        halo_.slots_.clear();
+        for (const ValueType& item : items_) {
+            for (const size_t& id : neighbors_function_(item)) {
+                if (id >= begin && id < begin + n) {
+                    halo_.slots_.push_back(id - begin);
+                    continue;
+                }
+                size_t p = common::CalculatePartition(
+                    global_size_, num_workers, id);
+                halo_.slots_.push_back(
+                    ghost_offset[p] +
+                    (std::lower_bound(wanted[p].begin(), wanted[p].end(), id) -
+                     wanted[p].begin()));
+            }
+            halo_.offsets_.push_back(halo_.slots_.size());
+        }
+        halo_.values_.resize(ghost_offset[num_workers]);
+
+        // the owners learn which of their values each worker wants
+        std::vector<size_t> all_workers(num_workers);
+        for (size_t p = 0; p < num_workers; ++p) all_workers[p] = p;
+        send_lists_.assign(num_workers, std::vector<size_t>());
+        SendReceive(
+            [&](data::CatStream::Writers& writers) {
+                for (size_t p = 0; p < num_workers; ++p) {
+                    for (const size_t& id : wanted[p]) writers[p].Put(id);
+                }
+            },
+            all_workers,
+            [&](size_t p, auto& reader) {
+                while (reader.HasNext())
+                    send_lists_[p].push_back(reader.template Next<size_t>() - begin);
+            });
+        // the owners of the ghosts, which the values come from
+        ghost_sources_.clear();
+        for (size_t p = 0; p < num_workers; ++p) {
+            if (!wanted[p].empty()) ghost_sources_.push_back(p);
+        }
+
+        // the workers which have ghosts owned by this one, the values go to
+        // them and come from the ghost_sources_ only
+        send_targets_.clear();
+        for (size_t p = 0; p < num_workers; ++p) {
+            if (!send_lists_[p].empty()) send_targets_.push_back(p);
+        }
+
+        // graphs numbered along a band, like grids, only have ghosts on the
+        // neighbouring workers. Their values then travel with Predecessor()
+        // and Successor() instead of the PeerChannel.
+        bool local = true;
+        for (size_t p = 0; p < num_workers; ++p) {
+            if (p + 1 != my_rank && p != my_rank + 1 && !wanted[p].empty())
+                local = false;
+        }
+        neighbour_only_ = context_.net.AllReduce(
+            local, [](bool a, bool b) { return a && b; });
+        if (neighbour_only_) {
+            ghosts_prev_ = my_rank > 0 ? wanted[my_rank - 1].size() : 0;
+            size_t prev = my_rank > 0 ? send_lists_[my_rank - 1].size() : 0;
+            size_t next = my_rank + 1 < num_workers
+                          ? send_lists_[my_rank + 1].size() : 0;
+            count_prev_ = context_.net.AllReduce(
+                prev, [](size_t a, size_t b) { return std::max(a, b); });
+            count_next_ = context_.net.AllReduce(
+                next, [](size_t a, size_t b) { return std::max(a, b); });
+        }
+
+        sLOG << "InterMapGraph: local vertices" << n
+             << "ghosts" << halo_.ghosts()
+             << "neighbour_only" << neighbour_only_;
+    }
+
+    /*!
+     * Runs send(writers) on the writers of a new CatStream, each of which
+     * delivers only to its worker, closes them and then calls receive(p,
+     * reader) for the items from each worker p in sources, in this order. A
+     * reader ends once its worker has closed the writer to this one, so only
+     * the sources have to be done.
+     */
+    template <typename SendFunction, typename ReceiveFunction>
+    void SendReceive(const SendFunction& send,
+                     const std::vector<size_t>& sources,
+                     const ReceiveFunction& receive) {
+        data::CatStreamPtr stream = context_.GetNewCatStream(this);
+        data::CatStream::Writers writers = stream->GetWriters();
+        send(writers);
+        writers.Close();
+        for (const size_t& p : sources) {
+            data::CatStream::Reader reader = stream->GetReaderFrom(p);
+            receive(p, reader);
+        }
+    }
+
+    //! Values of the local vertices sent to worker p, padded to count.
+    std::vector<HaloType> SendValues(size_t p, size_t count) const {
+        std::vector<HaloType> out;
+        out.reserve(count);
+        for (const size_t& i : send_lists_[p]) out.push_back(halo_.values_[i]);
+        out.resize(count);
+        return out;
+    }
+
+    //! Publishes the values of the local vertices and receives the values of
+    //! the ghost vertices.
+    void ExchangeGhosts() {
+        const size_t num_workers = context_.num_workers();
+        const size_t my_rank = context_.my_rank();
+        const size_t n = items_.size();
+        for (size_t i = 0; i < n; ++i)
+            halo_.values_[i] = publish_function_(items_[i]);
+
+        // the ghosts are ordered by owner and id, as the owners send them
+        size_t g = n;
+        if (neighbour_only_) {
+            // every worker sends exactly count values, so that Predecessor()
+            // and Successor() do not reach past the neighbouring worker
+            if (count_next_ != 0) {
+                std::vector<HaloType> from_prev = context_.net.Predecessor(
+                    count_next_, my_rank + 1 < num_workers
+                    ? SendValues(my_rank + 1, count_next_)
+                    : std::vector<HaloType>(count_next_));
+                for (size_t k = 0; k < ghosts_prev_; ++k)
+                    halo_.values_[g++] = from_prev[k];
+            }
+            if (count_prev_ != 0) {
+                std::vector<HaloType> from_next = context_.net.Successor(
+                    count_prev_, my_rank > 0
+                    ? SendValues(my_rank - 1, count_prev_)
+                    : std::vector<HaloType>(count_prev_));
+                for (size_t k = 0; g < halo_.values_.size(); ++k)
+                    halo_.values_[g++] = from_next[k];
+            }
+            return;
+        }
+
+        // each worker only exchanges with the workers it shares ghosts with,
+        // a message per pair and iteration on the long-lived PeerChannel
+        data::PeerChannel& channel = context_.peer_channel();
+        for (const size_t& p : send_targets_)
+            channel.Send(p, this->dia_id(), SendValues(p, send_lists_[p].size()));
+        for (const size_t& p : ghost_sources_) {
+            for (const HaloType& v :
+                 channel.template Receive<HaloType>(p, this->dia_id()))
+                halo_.values_[g++] = v;
+        }
+        die_unless(g == halo_.values_.size());
+    }
+};
+
+template <typename ValueType, typename Stack>
+template <typename IdFunction, typename NeighborsFunction,
+          typename PublishFunction, typename IterateFunction,
+          typename ConvergedFunction>
+auto DIA<ValueType, Stack>::InterMapGraph(
+    const IdFunction& id_function,
+    const NeighborsFunction& neighbors_function,
+    const PublishFunction& publish_function,
+    const IterateFunction& iterate_function, size_t max_iterations,
+    const ConvergedFunction& converged_function, size_t check_interval) const {
+    assert(IsValid());
+
+    using InterMapGraphNode = api::InterMapGraphNode<
+              ValueType, IdFunction, NeighborsFunction, PublishFunction,
+              IterateFunction, ConvergedFunction>;
+
+    auto node = tlx::make_counting<InterMapGraphNode>(
+        *this, id_function, neighbors_function, publish_function,
+        iterate_function, max_iterations, converged_function, check_interval);
+
+    return DIA<ValueType>(node);
+}
+
+} // namespace api
+} // namespace thrill
+
+#endif // !THRILL_API_INTER_MAP_GRAPH_HEADER
+
+/******************************************************************************/
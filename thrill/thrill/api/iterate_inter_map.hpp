@@ -0,0 +1,307 @@
+/*******************************************************************************
+ * thrill/api/iterate_inter_map.hpp
+ *
+ * DIANode for an iterated InterMap: the local partition stays resident in one
+ * worker-local buffer and only the halo lines are exchanged between the
+ * iterations. A DIA is materialized only once the loop has finished.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_API_ITERATE_INTER_MAP_HEADER
+#define THRILL_API_ITERATE_INTER_MAP_HEADER
+
+#include <thrill/api/dia.hpp>
+#include <thrill/api/dop_node.hpp>
+#include <thrill/common/logger.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace thrill {
+namespace api {
+
+/*!
+ * IterateInterMapNode collects the local items of its parent and then runs the
+ * iteration function up to max_iterations times on them. Before each iteration
+ * up_lines lines are fetched from the preceding worker and down_lines lines
+ * from the succeeding one, each line consisting of line_element_num items. The
+ * buffer handed to the function has the same [up | local | down] layout as the
+ * one of InterMap2D; the function updates it in place and returns the residual
+ * of the local part.
+ *
+ * Every check_interval iterations the residuals of all workers are summed up
+ * and passed to the convergence predicate, all workers leave the loop together
+ * once it returns true. The iterations are counted from first_iteration, so a
+ * resumed loop runs the iterations first_iteration + 1 .. max_iterations and
+ * checks at the same iterations as the original one.
+ *
+ * If up_fields or down_fields are given, only these item indexes of each halo
+ * line are refreshed after the first iteration, which transfers whole lines to
+ * set up the halo. The remaining items of the halo lines keep their initial
+ * values. An empty field list refreshes whole lines.
+ *
+ * \ingroup api_layer
+ */
+template <typename ValueType, typename IterateFunction,
+          typename ConvergedFunction>
+class IterateInterMapNode final : public DOpNode<ValueType>
+{
+    static constexpr bool debug = false;
+
+public:
+    using Super = DOpNode<ValueType>;
+    using Super::context_;
+
+    template <typename ParentDIA>
+    IterateInterMapNode(const ParentDIA& parent,
+                        const IterateFunction& iterate_function,
+                        size_t line_element_num,
+                        size_t up_lines, size_t down_lines,
+                        const std::vector<size_t>& up_fields,
+                        const std::vector<size_t>& down_fields,
+                        size_t max_iterations,
+                        const ConvergedFunction& converged_function,
+                        size_t check_interval, size_t first_iteration)
+        : Super(parent.ctx(), "IterateInterMap",
+                { parent.id() }, { parent.node() }),
+          iterate_function_(iterate_function),
+          converged_function_(converged_function),
+          line_element_num_(line_element_num),
+          up_lines_(up_lines), down_lines_(down_lines),
+          up_fields_(up_fields), down_fields_(down_fields),
+          up_num_(line_element_num * up_lines),
+          down_num_(line_element_num * down_lines),
+          max_iterations_(max_iterations),
+          check_interval_(check_interval),
+          first_iteration_(first_iteration) {
+        auto pre_op_fn = [this](const ValueType& input) {
+                             values_.push_back(input);
+                         };
+        auto lop_chain = parent.stack().push(pre_op_fn).fold();
+        parent.node()->AddChild(this, lop_chain);
+
+        for (const size_t& f : up_fields_) assert(f < line_element_num_);
+        for (const size_t& f : down_fields_) assert(f < line_element_num_);
+    }
+
+    void StopPreOp(size_t /* parent_index */) final {
+        local_size_ = values_.size();
+    }
+
+    //! Runs all iterations on the resident buffer.
+    void Execute() final {
+        size_t iter = first_iteration_;
+        while (iter < max_iterations_) {
+            ExchangeHalos();
+
+            double residual = iterate_function_(values_);
+            ++iter;
+
+            if (check_interval_ != 0 && iter % check_interval_ == 0) {
+                double global_residual = context_.net.AllReduce(residual);
+                LOG << "IterateInterMap() iteration " << iter
+                    << " residual " << global_residual;
+                if (converged_function_(global_residual, iter)) break;
+            }
+        }
+    }
+
+    void PushData(bool /* consume */) final {
+        for (size_t i = up_size_; i < up_size_ + local_size_; ++i) {
+            this->PushItem(values_[i]);
+        }
+    }
+
+    void Dispose() final {
+        std::vector<ValueType>().swap(values_);
+        std::vector<ValueType>().swap(send_up_);
+        std::vector<ValueType>().swap(send_down_);
+    }
+
+private:
+    IterateFunction iterate_function_;
+    ConvergedFunction converged_function_;
+
+    size_t line_element_num_;
+    size_t up_lines_, down_lines_;
+    //! items of the halo lines refreshed in each iteration, empty for all.
+    std::vector<size_t> up_fields_, down_fields_;
+    //! cached index list of all items of a line
+    std::vector<size_t> all_fields_;
+
+    //! number of items received from the predecessor and successor
+    size_t up_num_, down_num_;
+    size_t max_iterations_;
+    size_t check_interval_;
+    size_t first_iteration_;
+
+    //! resident buffer with layout [up halo | local items | down halo]
+    std::vector<ValueType> values_;
+    size_t local_size_ = 0;
+    size_t up_size_ = 0, down_size_ = 0;
+    //! whether values_ already contains the halo slots
+    bool halo_placed_ = false;
+
+    //! boundary items of the local part sent to the neighbours
+    std::vector<ValueType> send_up_, send_down_;
+
+    //! Fetches the halo lines of both neighbours into values_. The first call
+    //! places the halo slots around the local items, afterwards they are only
+    //! overwritten.
+    void ExchangeHalos() {
+        if (halo_placed_ && (!up_fields_.empty() || !down_fields_.empty())) {
+            ExchangeHaloFields();
+            return;
+        }
+
+        auto local_begin = values_.begin() + up_size_;
+        auto local_end = local_begin + local_size_;
+
+        std::vector<ValueType> up_values, down_values;
+        if (up_num_ > 0) {
+            send_down_.assign(
+                local_size_ <= up_num_ ? local_begin : local_end - up_num_,
+                local_end);
+            up_values = context_.net.Predecessor(up_num_, send_down_);
+        }
+        if (down_num_ > 0) {
+            send_up_.assign(
+                local_begin,
+                local_size_ <= down_num_ ? local_end : local_begin + down_num_);
+            down_values = context_.net.Successor(down_num_, send_up_);
+        }
+
+        if (!halo_placed_) {
+            up_size_ = up_values.size();
+            down_size_ = down_values.size();
+            values_.insert(values_.begin(),
+                           up_values.begin(), up_values.end());
+            values_.insert(values_.end(),
+                           down_values.begin(), down_values.end());
+            halo_placed_ = true;
+            return;
+        }
+
+        // the partition does not change, hence neither do the halo sizes.
+        assert(up_values.size() == up_size_);
+        assert(down_values.size() == down_size_);
+        std::copy(up_values.begin(), up_values.end(), values_.begin());
+        std::copy(down_values.begin(), down_values.end(),
+                  values_.begin() + up_size_ + local_size_);
+    }
+
+    //! Packs the given fields of the lines [begin_line, end_line) of values_.
+    void PackFields(size_t begin_line, size_t end_line,
+                    const std::vector<size_t>& fields,
+                    std::vector<ValueType>& out) const {
+        out.clear();
+        for (size_t l = begin_line; l < end_line; ++l) {
+            for (const size_t& f : fields)
+                out.push_back(values_[l * line_element_num_ + f]);
+        }
+    }
+
+    //! Unpacks the packed lines [in_line, in_line + lines) of fields in into
+    //! values_, starting at line first_line.
+    void UnpackFields(const std::vector<ValueType>& in, size_t in_line,
+                      size_t first_line, size_t lines,
+                      const std::vector<size_t>& fields) {
+        for (size_t l = 0; l < lines; ++l) {
+            for (size_t j = 0; j < fields.size(); ++j) {
+                values_[(first_line + l) * line_element_num_ + fields[j]] =
+                    in[(in_line + l) * fields.size() + j];
+            }
+        }
+    }
+
+    //! Refreshes only the requested fields of the halo lines, whole lines are
+    //! sent for a halo without field list. The halo keeps the size placed by
+    //! the first exchange, at most that many lines are unpacked, the ones
+    //! next to the local items.
+    void ExchangeHaloFields() {
+        size_t up_halo_lines = up_size_ / line_element_num_;
+        size_t local_lines = local_size_ / line_element_num_;
+
+        if (up_lines_ > 0) {
+            const std::vector<size_t>& fields =
+                up_fields_.empty() ? AllFields() : up_fields_;
+            PackFields(
+                up_halo_lines + (local_lines <= up_lines_ ? 0 : local_lines - up_lines_),
+                up_halo_lines + local_lines, fields, send_down_);
+            std::vector<ValueType> up_values = context_.net.Predecessor(
+                up_lines_ * fields.size(), send_down_);
+            size_t received = up_values.size() / fields.size();
+            size_t lines = std::min(received, up_halo_lines);
+            UnpackFields(up_values, received - lines, up_halo_lines - lines,
+                         lines, fields);
+        }
+        if (down_lines_ > 0) {
+            const std::vector<size_t>& fields =
+                down_fields_.empty() ? AllFields() : down_fields_;
+            PackFields(
+                up_halo_lines,
+                up_halo_lines + std::min(local_lines, down_lines_),
+                fields, send_up_);
+            std::vector<ValueType> down_values = context_.net.Successor(
+                down_lines_ * fields.size(), send_up_);
+            size_t lines = std::min(down_values.size() / fields.size(),
+                                    down_size_ / line_element_num_);
+            UnpackFields(down_values, 0, up_halo_lines + local_lines, lines,
+                         fields);
+        }
+    }
+
+    //! Index list of all items of a line.
+    const std::vector<size_t>& AllFields() {
+        if (all_fields_.size() != line_element_num_) {
+            all_fields_.resize(line_element_num_);
+            for (size_t i = 0; i < line_element_num_; ++i) all_fields_[i] = i;
+        }
+        return all_fields_;
+    }
+};
+
+template <typename ValueType, typename Stack>
+template <typename IterateFunction, typename ConvergedFunction>
+auto DIA<ValueType, Stack>::IterateInterMap(
+    const IterateFunction& iterate_function, size_t line_element_num,
+    size_t up_lines, size_t down_lines, size_t max_iterations,
+    const ConvergedFunction& converged_function, size_t check_interval) const {
+    return IterateInterMap(
+        iterate_function, line_element_num, up_lines, down_lines,
+        std::vector<size_t>(), std::vector<size_t>(),
+        max_iterations, converged_function, check_interval);
+}
+
+template <typename ValueType, typename Stack>
+template <typename IterateFunction, typename ConvergedFunction>
+auto DIA<ValueType, Stack>::IterateInterMap(
+    const IterateFunction& iterate_function, size_t line_element_num,
+    size_t up_lines, size_t down_lines,
+    const std::vector<size_t>& up_fields,
+    const std::vector<size_t>& down_fields, size_t max_iterations,
+    const ConvergedFunction& converged_function, size_t check_interval,
+    size_t first_iteration) const {
+    assert(IsValid());
+
+    using IterateInterMapNode = api::IterateInterMapNode<
+              ValueType, IterateFunction, ConvergedFunction>;
+
+    auto node = tlx::make_counting<IterateInterMapNode>(
+        *this, iterate_function, line_element_num, up_lines, down_lines,
+        up_fields, down_fields, max_iterations, converged_function,
+        check_interval, first_iteration);
+
+    return DIA<ValueType>(node);
+}
+
+} // namespace api
+} // namespace thrill
+
+#endif // !THRILL_API_ITERATE_INTER_MAP_HEADER
+
+/******************************************************************************/
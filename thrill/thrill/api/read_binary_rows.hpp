@@ -0,0 +1,256 @@
+/*******************************************************************************
+ * thrill/api/read_binary_rows.hpp
+ *
+ * Source for files of fixed-width rows of plain values, e.g. the rows of a
+ * banded matrix. The DIA is split at row boundaries, so that each worker holds
+ * whole rows, and the values are emitted without any parsing.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_API_READ_BINARY_ROWS_HEADER
+#define THRILL_API_READ_BINARY_ROWS_HEADER
+
+#include <thrill/api/context.hpp>
+#include <thrill/api/dia.hpp>
+#include <thrill/api/source_node.hpp>
+#include <thrill/common/logger.hpp>
+#include <thrill/common/math.hpp>
+#include <thrill/common/system_exception.hpp>
+#include <thrill/vfs/file_io.hpp>
+
+#include <tlx/die.hpp>
+#include <tlx/string/join.hpp>
+#include <tlx/vector_free.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace thrill {
+namespace api {
+
+/*!
+ * Header at the beginning of each binary rows file. It is followed by rows *
+ * row_size values of value_size bytes each, in host byte order.
+ */
+struct BinaryRowsHeader {
+    //! "THRROWS" and the format version
+    char     magic[8];
+    //! size of one value in bytes
+    uint64_t value_size;
+    //! number of values in a row
+    uint64_t row_size;
+    //! number of rows in the file
+    uint64_t rows;
+
+    static constexpr const char* magic_v1 = "THRROWS1";
+
+    //! Creates a header for rows of row_size values of type ValueType.
+    template <typename ValueType>
+    static BinaryRowsHeader Make(size_t row_size, size_t rows) {
+        BinaryRowsHeader h;
+        std::memcpy(h.magic, magic_v1, sizeof(h.magic));
+        h.value_size = sizeof(ValueType);
+        h.row_size = row_size;
+        h.rows = rows;
+        return h;
+    }
+
+    bool IsValid() const {
+        return std::memcmp(magic, magic_v1, sizeof(magic)) == 0;
+    }
+};
+
+static_assert(sizeof(BinaryRowsHeader) == 32,
+              "BinaryRowsHeader must not contain padding");
+
+/*!
+ * A DIANode which reads binary rows files. Each worker reads its range of
+ * whole rows directly from the files and pushes the values one by one.
+ *
+ * \ingroup api_layer
+ */
+template <typename ValueType>
+class ReadBinaryRowsNode final : public SourceNode<ValueType>
+{
+    static constexpr bool debug = false;
+
+    static_assert(std::is_trivially_copyable<ValueType>::value,
+                  "ReadBinaryRows needs plain values");
+
+public:
+    using Super = SourceNode<ValueType>;
+    using Super::context_;
+
+    //! structure to store info on what to read from files
+    struct FileInfo {
+        std::string   path;
+        //! begin and end byte offsets in file.
+        common::Range range;
+    };
+
+    ReadBinaryRowsNode(Context& ctx, const std::vector<std::string>& globlist,
+                       size_t row_size)
+        : Super(ctx, "ReadBinaryRows") {
+
+        vfs::FileList files = vfs::Glob(globlist, vfs::GlobType::File);
+
+        if (files.size() == 0)
+            die("ReadBinaryRows: no files found in globs: " + tlx::join(' ', globlist));
+        if (files.contains_compressed)
+            die("ReadBinaryRows: compressed files cannot be split by rows");
+
+        const size_t row_bytes = row_size * sizeof(ValueType);
+
+        // read all headers and calculate the prefix sum of rows
+        std::vector<size_t> rows_psum(files.size() + 1, 0);
+        for (size_t i = 0; i < files.size(); ++i) {
+            BinaryRowsHeader header = ReadHeader(files[i].path);
+
+            if (header.value_size != sizeof(ValueType) ||
+                header.row_size != row_size)
+                die("ReadBinaryRows: path " + files[i].path +
+                    " has rows of " << header.row_size << " values of " <<
+                    header.value_size << " bytes, expected " << row_size <<
+                    " values of " << sizeof(ValueType) << " bytes");
+
+            if (files[i].size != sizeof(header) + header.rows * row_bytes)
+                die("ReadBinaryRows: path " + files[i].path +
+                    " size does not match the " << header.rows << " rows in its header");
+
+            rows_psum[i + 1] = rows_psum[i] + header.rows;
+        }
+
+        common::Range my_rows = context_.CalculateLocalRange(rows_psum.back());
+
+        sLOG << "ReadBinaryRowsNode:" << ctx.num_workers()
+             << "my_rows" << my_rows;
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            size_t begin = std::max(my_rows.begin, rows_psum[i]);
+            size_t end = std::min(my_rows.end, rows_psum[i + 1]);
+            if (begin >= end) continue;
+
+            FileInfo fi;
+            fi.path = files[i].path;
+            fi.range = common::Range(
+                sizeof(BinaryRowsHeader) + (begin - rows_psum[i]) * row_bytes,
+                sizeof(BinaryRowsHeader) + (end - rows_psum[i]) * row_bytes);
+            my_files_.push_back(fi);
+
+            sLOG << "ReadBinaryRows: fileinfo"
+                 << "path" << fi.path << "range" << fi.range;
+        }
+    }
+
+    void PushData(bool /* consume */) final {
+        LOG << "ReadBinaryRowsNode::PushData() start " << *this;
+
+        std::vector<ValueType> buffer(block_items_);
+
+        for (const FileInfo& file : my_files_) {
+            vfs::ReadStreamPtr stream = vfs::OpenReadStream(file.path, file.range);
+
+            size_t remain = file.range.size();
+            while (remain > 0) {
+                size_t bytes = std::min(remain, block_items_ * sizeof(ValueType));
+                ReadFully(stream, buffer.data(), bytes, file.path);
+                remain -= bytes;
+
+                for (size_t i = 0; i < bytes / sizeof(ValueType); ++i)
+                    this->PushItem(buffer[i]);
+            }
+            stream->close();
+        }
+    }
+
+    void Dispose() final {
+        tlx::vector_free(my_files_);
+    }
+
+    //! Reads the header of a binary rows file.
+    static BinaryRowsHeader ReadHeader(const std::string& path) {
+        BinaryRowsHeader header;
+        vfs::ReadStreamPtr stream = vfs::OpenReadStream(
+            path, common::Range(0, sizeof(header)));
+        ReadFully(stream, &header, sizeof(header), path);
+        stream->close();
+
+        if (!header.IsValid())
+            die("ReadBinaryRows: path " + path + " is not a binary rows file");
+        return header;
+    }
+
+private:
+    //! number of values read from the stream at once
+    static constexpr size_t block_items_ = 1024 * 1024 / sizeof(ValueType);
+
+    //! list of files and byte ranges to read
+    std::vector<FileInfo> my_files_;
+
+    static void ReadFully(vfs::ReadStreamPtr& stream, void* data, size_t size,
+                          const std::string& path) {
+        char* ptr = reinterpret_cast<char*>(data);
+        while (size > 0) {
+            ssize_t rb = stream->read(ptr, size);
+            if (rb < 0)
+                throw common::ErrnoException("Error reading vfs file " + path);
+            if (rb == 0)
+                die("ReadBinaryRows: unexpected end of file in " + path);
+            ptr += rb, size -= rb;
+        }
+    }
+};
+
+/*!
+ * ReadBinaryRows is a DOp, which reads files of fixed-width rows of
+ * row_size values, each starting with a BinaryRowsHeader, and creates a DIA of
+ * the values. The DIA is split among the workers at row boundaries, such that
+ * it can be processed directly by InterMap2D(..., row_size, ...).
+ *
+ * \param ctx Reference to the context object
+ * \param filepath Paths of the files in the file system
+ * \param row_size Number of values in a row
+ *
+ * \ingroup dia_sources
+ */
+template <typename ValueType>
+DIA<ValueType> ReadBinaryRows(
+    Context& ctx, const std::vector<std::string>& filepath, size_t row_size) {
+
+    auto node = tlx::make_counting<ReadBinaryRowsNode<ValueType> >(
+        ctx, filepath, row_size);
+
+    return DIA<ValueType>(node);
+}
+
+/*!
+ * ReadBinaryRows is a DOp, which reads files of fixed-width rows of
+ * row_size values, each starting with a BinaryRowsHeader, and creates a DIA of
+ * the values.
+ *
+ * \ingroup dia_sources
+ */
+template <typename ValueType>
+DIA<ValueType> ReadBinaryRows(
+    Context& ctx, const std::string& filepath, size_t row_size) {
+    return ReadBinaryRows<ValueType>(
+        ctx, std::vector<std::string>{ filepath }, row_size);
+}
+
+} // namespace api
+
+//! imported from api namespace
+using api::ReadBinaryRows;
+
+} // namespace thrill
+
+#endif // !THRILL_API_READ_BINARY_ROWS_HEADER
+
+/******************************************************************************/
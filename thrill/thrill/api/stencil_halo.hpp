@@ -0,0 +1,402 @@
+/*******************************************************************************
+ * thrill/api/stencil_halo.hpp
+ *
+ * Worker-local tile of a D-dimensional grid with ghost cells around it, and
+ * the halo exchange of the stencil InterMap nodes.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_API_STENCIL_HALO_HEADER
+#define THRILL_API_STENCIL_HALO_HEADER
+
+#include <thrill/common/cartesian_grid.hpp>
+#include <thrill/data/peer_channel.hpp>
+
+#include <tlx/die.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace thrill {
+namespace api {
+
+/*!
+ * StencilHalo keeps the worker's tile of a grid split by a CartesianGrid in a
+ * padded buffer, which has lower[d] ghost layers below and upper[d] above the
+ * tile in each dimension d, all row-major with dimension 0 the slowest. The
+ * items of the tile are placed as they arrive, the ghost layers are filled by
+ * Exchange() from the neighbouring workers.
+ *
+ * Without corners, each worker only receives the parts of the neighbours'
+ * tiles next to its faces. With corners, the dimensions are exchanged one
+ * after the other and each phase forwards the ghost layers received in the
+ * phases before, so the edges and corners of the neighbourhood arrive from
+ * the face neighbours without messages to the diagonal ones.
+ *
+ * The layers go over the Context's PeerChannel, one message per phase to each
+ * neighbour, so each worker only waits for its own neighbours.
+ *
+ * Dimensions marked periodic wrap around: the first and the last workers
+ * along them are neighbours, and the ghost layers at the border of the grid
+ * hold the points from its other end.
+ */
+template <typename ValueType, size_t D>
+class StencilHalo
+{
+public:
+    using Grid = common::CartesianGrid<D>;
+    using Index = typename Grid::Index;
+    using Offset = std::array<ptrdiff_t, D>;
+
+    StencilHalo(const Grid& grid, size_t rank,
+                const Index& lower, const Index& upper, bool corners,
+                const std::array<bool, D>& periodic)
+        : grid_(grid), coords_(grid.Coordinates(rank)),
+          lower_(lower), upper_(upper), corners_(corners),
+          periodic_(periodic) {
+        size_t size = 1;
+        for (size_t d = D; d-- > 0; ) {
+            tile_[d] = grid_.LocalRange(d, coords_[d]).size();
+            padded_[d] = lower_[d] + tile_[d] + upper_[d];
+            stride_[d] = size;
+            size *= padded_[d];
+            has_lower_[d] = periodic_[d] || coords_[d] > 0;
+            has_upper_[d] = periodic_[d] || coords_[d] + 1 < grid_.workers()[d];
+        }
+        values_.resize(size);
+        cursor_.fill(0);
+        next_ = PaddedIndex(cursor_);
+    }
+
+    //! number of phases of Exchange(), one message to each neighbour each
+    size_t phases() const { return corners_ ? D : 1; }
+
+    //! Places the next item of the tile, in row-major order.
+    void push_back(const ValueType& v) {
+        die_unless(count_ < TileSize());
+        values_[next_] = v;
+        ++count_;
+        // advance the cursor like an odometer
+        for (size_t d = D; d-- > 0; ) {
+            if (++cursor_[d] < tile_[d]) break;
+            if (d == 0) break;
+            cursor_[d] = 0;
+        }
+        next_ = PaddedIndex(cursor_);
+    }
+
+    /*!
+     * Fills the ghost layers from the neighbouring workers, with messages of
+     * the tag on the channel, e.g. the dia_id of the node. The neighbours send
+     * their layers nearest to this worker first.
+     */
+    void Exchange(data::PeerChannel& channel, size_t tag) {
+        Post(channel, tag);
+        Finish(channel, tag);
+    }
+
+    /*!
+     * First half of Exchange(): sends the layers of the first phase, which
+     * only come from the tile. They travel in the background while the
+     * worker computes the inner points.
+     */
+    void Post(data::PeerChannel& channel, size_t tag) {
+        die_unless(count_ == TileSize());
+        for (size_t d = 0; d < D; ++d) {
+            die_unless(!has_lower_[d] || tile_[d] >= upper_[d]);
+            die_unless(!has_upper_[d] || tile_[d] >= lower_[d]);
+        }
+
+        SendPhase(channel, tag, 0);
+    }
+
+    //! Second half of Exchange(): waits for the layers of the first phase and
+    //! runs the other phases, which forward them.
+    void Finish(data::PeerChannel& channel, size_t tag) {
+        ReceivePhase(channel, tag, 0);
+        for (size_t phase = 1; phase < phases(); ++phase) {
+            SendPhase(channel, tag, phase);
+            ReceivePhase(channel, tag, phase);
+        }
+    }
+
+    //! Calls f(position, padded index) for each point of the tile, row-major.
+    template <typename Function>
+    void ForEachPoint(const Function& f) const {
+        Index lo, hi;
+        for (size_t d = 0; d < D; ++d) lo[d] = 0, hi[d] = tile_[d];
+        ForEachInBox(lo, hi, [&](const Index& pos) { f(pos, PaddedIndex(pos)); });
+    }
+
+    //! Calls f(position, padded index) for the inner points of the tile,
+    //! whose neighbours within the halo widths all lie in the tile, so they
+    //! are ready before Finish().
+    template <typename Function>
+    void ForEachInnerPoint(const Function& f) const {
+        Index lo, hi;
+        InnerBox(lo, hi);
+        ForEachInBox(lo, hi, [&](const Index& pos) { f(pos, PaddedIndex(pos)); });
+    }
+
+    //! Calls f(position, padded index) for the other points of the tile, the
+    //! band along the faces which need the ghost layers, row-major.
+    template <typename Function>
+    void ForEachBorderPoint(const Function& f) const {
+        Index inner_lo, inner_hi;
+        InnerBox(inner_lo, inner_hi);
+        // walk the lines along the last dimension, which are either outside
+        // of the inner box or have the inner points in the middle
+        Index lo, hi;
+        for (size_t d = 0; d < D; ++d) lo[d] = 0, hi[d] = tile_[d];
+        hi[D - 1] = 1;
+        ForEachInBox(lo, hi, [&](Index pos) {
+                         bool inner = true;
+                         for (size_t d = 0; d + 1 < D; ++d) {
+                             inner = inner && inner_lo[d] <= pos[d] && pos[d] < inner_hi[d];
+                         }
+                         size_t& c = pos[D - 1];
+                         for (c = 0; c < tile_[D - 1]; ++c) {
+                             if (inner && c == inner_lo[D - 1]) c = inner_hi[D - 1];
+                             if (c >= tile_[D - 1]) break;
+                             f(pos, PaddedIndex(pos));
+                         }
+                     });
+    }
+
+    //! row-major index of the point pos in the tile
+    size_t TileIndex(const Index& pos) const {
+        size_t index = 0;
+        for (size_t d = 0; d < D; ++d) index = index * tile_[d] + pos[d];
+        return index;
+    }
+
+    //! Whether the point at offset delta of the tile point pos is in the grid,
+    //! or wraps around in a periodic dimension, and within the ghost layers.
+    bool Contains(const Index& pos, const Offset& delta) const {
+        size_t outside = 0;
+        for (size_t d = 0; d < D; ++d) {
+            ptrdiff_t p = static_cast<ptrdiff_t>(pos[d]) + delta[d];
+            if (delta[d] < -static_cast<ptrdiff_t>(lower_[d]) ||
+                delta[d] > static_cast<ptrdiff_t>(upper_[d]))
+                return false;
+            if (p < 0) {
+                if (!has_lower_[d]) return false;
+                ++outside;
+            }
+            else if (p >= static_cast<ptrdiff_t>(tile_[d])) {
+                if (!has_upper_[d]) return false;
+                ++outside;
+            }
+        }
+        return outside <= 1 || corners_;
+    }
+
+    //! Number of points from the tile point pos towards lower (dir < 0) or
+    //! higher (dir > 0) indexes of dimension d which Contains().
+    size_t Count(const Index& pos, size_t d, int dir) const {
+        if (dir < 0) return has_lower_[d] ? lower_[d] : std::min(lower_[d], pos[d]);
+        return has_upper_[d] ? upper_[d] : std::min(upper_[d], tile_[d] - 1 - pos[d]);
+    }
+
+    //! distance in the padded buffer of neighbours along dimension d
+    size_t stride(size_t d) const { return stride_[d]; }
+
+    const std::vector<ValueType>& values() const { return values_; }
+
+    size_t TileSize() const {
+        size_t size = 1;
+        for (size_t d = 0; d < D; ++d) size *= tile_[d];
+        return size;
+    }
+
+    //! Releases the memory.
+    void Clear() {
+        std::vector<ValueType>().swap(values_);
+    }
+
+private:
+    Grid grid_;
+    Index coords_;
+    //! extents of the tile, ghost layer widths and extents of the buffer
+    Index tile_, lower_, upper_, padded_, stride_;
+    std::array<bool, D> has_lower_, has_upper_;
+    bool corners_;
+    std::array<bool, D> periodic_;
+
+    std::vector<ValueType> values_;
+    //! tile position and padded index of the next item, number of items
+    Index cursor_;
+    size_t next_ = 0;
+    size_t count_ = 0;
+
+    size_t PaddedIndex(const Index& pos) const {
+        size_t index = 0;
+        for (size_t d = 0; d < D; ++d) index += (lower_[d] + pos[d]) * stride_[d];
+        return index;
+    }
+
+    //! The box of the inner points: lo <= pos < hi, may be empty.
+    void InnerBox(Index& lo, Index& hi) const {
+        for (size_t d = 0; d < D; ++d) {
+            lo[d] = has_lower_[d] ? std::min(lower_[d], tile_[d]) : 0;
+            hi[d] = has_upper_[d] ? tile_[d] - std::min(upper_[d], tile_[d]) : tile_[d];
+            hi[d] = std::max(lo[d], hi[d]);
+        }
+    }
+
+    //! Calls f(pos) for all positions lo <= pos < hi, row-major.
+    template <typename Function>
+    static void ForEachInBox(const Index& lo, const Index& hi, const Function& f) {
+        for (size_t d = 0; d < D; ++d) {
+            if (lo[d] >= hi[d]) return;
+        }
+        Index pos = lo;
+        while (true) {
+            f(pos);
+            size_t d = D;
+            while (d-- > 0) {
+                if (++pos[d] < hi[d]) break;
+                pos[d] = lo[d];
+            }
+            if (d == static_cast<size_t>(-1)) return;
+        }
+    }
+
+    //! The box of the layer at tile position layer of dimension d which is
+    //! exchanged in the phase of d: the tile in the dimensions which are not
+    //! yet exchanged, with the ghost layers in those exchanged before.
+    void LayerBox(size_t d, size_t layer, Index& lo, Index& hi) const {
+        for (size_t e = 0; e < D; ++e) {
+            bool ghosts = corners_ && e < d;
+            lo[e] = ghosts ? 0 : lower_[e];
+            hi[e] = ghosts ? padded_[e] : lower_[e] + tile_[e];
+        }
+        lo[d] = layer, hi[d] = layer + 1;
+    }
+
+    //! Calls f(padded index) for the points of a layer box.
+    template <typename Function>
+    void ForEachInLayer(size_t d, size_t layer, const Function& f) const {
+        Index lo, hi;
+        LayerBox(d, layer, lo, hi);
+        ForEachInBox(lo, hi, [&](const Index& pos) {
+                         size_t index = 0;
+                         for (size_t e = 0; e < D; ++e) index += pos[e] * stride_[e];
+                         f(index);
+                     });
+    }
+
+    //! rank of the neighbouring worker, wrapping around periodic dimensions.
+    //! With one or two workers along d, both neighbours are the same worker,
+    //! the tags of the layers tell the directions apart.
+    size_t Neighbor(size_t d, int dir) const {
+        Index c = coords_;
+        size_t workers = grid_.workers()[d];
+        c[d] = dir < 0 ? (c[d] + workers - 1) % workers : (c[d] + 1) % workers;
+        return grid_.Rank(c);
+    }
+
+    //! dimensions exchanged in a phase
+    size_t FirstDim(size_t phase) const { return corners_ ? phase : 0; }
+    size_t LastDim(size_t phase) const { return corners_ ? phase + 1 : D; }
+
+    //! layers tagged with their direction, see Send()
+    using Message = std::vector<std::pair<ValueType, int> >;
+
+    //! neighbours of a phase, each once. A worker sends one message to each
+    //! of them, and as the neighbourhood is symmetric, receives one from each.
+    std::vector<size_t> PhaseNeighbors(size_t phase) const {
+        std::vector<size_t> peers;
+        for (size_t d = FirstDim(phase); d < LastDim(phase); ++d) {
+            if (has_lower_[d]) peers.push_back(Neighbor(d, -1));
+            if (has_upper_[d]) peers.push_back(Neighbor(d, +1));
+        }
+        std::sort(peers.begin(), peers.end());
+        peers.erase(std::unique(peers.begin(), peers.end()), peers.end());
+        return peers;
+    }
+
+    void SendPhase(data::PeerChannel& channel, size_t tag, size_t phase) {
+        std::map<size_t, Message> outbox;
+        for (const size_t& peer : PhaseNeighbors(phase)) outbox[peer];
+        for (size_t d = FirstDim(phase); d < LastDim(phase); ++d) Send(outbox, d);
+        for (const auto& out : outbox) channel.Send(out.first, tag, out.second);
+    }
+
+    //! Reads the layers of a phase from the neighbours of the phase alone,
+    //! one message from each.
+    void ReceivePhase(data::PeerChannel& channel, size_t tag, size_t phase) {
+        std::array<std::vector<ValueType>, 2 * D> received;
+        for (const size_t& from : PhaseNeighbors(phase)) {
+            for (const std::pair<ValueType, int>& item :
+                 channel.template Receive<std::pair<ValueType, int> >(from, tag))
+                received[item.second].push_back(item.first);
+        }
+        for (size_t d = FirstDim(phase); d < LastDim(phase); ++d) Receive(received, d);
+    }
+
+    //! Adds the layers of dimension d which the neighbours need to their
+    //! messages, tagged 2d+1 for the upper ghost layers of the lower
+    //! neighbour and 2d for the lower ghost layers of the upper one.
+    void Send(std::map<size_t, Message>& outbox, size_t d) {
+        if (has_lower_[d]) {
+            Message& out = outbox[Neighbor(d, -1)];
+            for (size_t k = 0; k < upper_[d]; ++k) {
+                ForEachInLayer(d, lower_[d] + k, [&](size_t i) {
+                                   out.emplace_back(values_[i], int(2 * d + 1));
+                               });
+            }
+        }
+        if (has_upper_[d]) {
+            Message& out = outbox[Neighbor(d, +1)];
+            for (size_t k = 0; k < lower_[d]; ++k) {
+                ForEachInLayer(d, lower_[d] + tile_[d] - 1 - k, [&](size_t i) {
+                                   out.emplace_back(values_[i], int(2 * d));
+                               });
+            }
+        }
+    }
+
+    //! Places the layers of dimension d received from the neighbours.
+    void Receive(const std::array<std::vector<ValueType>, 2 * D>& received,
+                 size_t d) {
+        size_t n = 0;
+        const std::vector<ValueType>& from_upper = received[2 * d + 1];
+        if (has_upper_[d]) {
+            for (size_t k = 0; k < upper_[d]; ++k) {
+                ForEachInLayer(d, lower_[d] + tile_[d] + k, [&](size_t i) {
+                                   die_unless(n < from_upper.size());
+                                   values_[i] = from_upper[n++];
+                               });
+            }
+        }
+        die_unless(n == from_upper.size());
+
+        n = 0;
+        const std::vector<ValueType>& from_lower = received[2 * d];
+        if (has_lower_[d]) {
+            for (size_t k = 0; k < lower_[d]; ++k) {
+                ForEachInLayer(d, lower_[d] - 1 - k, [&](size_t i) {
+                                   die_unless(n < from_lower.size());
+                                   values_[i] = from_lower[n++];
+                               });
+            }
+        }
+        die_unless(n == from_lower.size());
+    }
+};
+
+} // namespace api
+} // namespace thrill
+
+#endif // !THRILL_API_STENCIL_HALO_HEADER
+
+/******************************************************************************/
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * thrill/common/cartesian_grid.hpp
+ *
+ * Cartesian decomposition of a D-dimensional grid of points over a grid of
+ * workers, shared by the GenerateND sources and the stencil InterMap nodes.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_COMMON_CARTESIAN_GRID_HEADER
+#define THRILL_COMMON_CARTESIAN_GRID_HEADER
+
+#include <thrill/common/math.hpp>
+
+#include <array>
+#include <cassert>
+#include <limits>
+
+namespace thrill {
+namespace common {
+
+/*!
+ * CartesianGrid splits a grid of extents[0] x ... x extents[D-1] points over
+ * num_workers workers, which form a workers()[0] x ... x workers()[D-1] grid
+ * whose product is exactly num_workers. Of all such worker grids it takes the
+ * one which cuts the point grid along the smallest surface, i.e. with the
+ * least halo data, preferring worker grids which leave no worker without
+ * points. Each dimension is split into ranges as by CalculateLocalRange(), so
+ * extents need not be divisible by the number of workers.
+ *
+ * Dimension 0 is the slowest one, the workers are numbered row-major:
+ * rank = (c[0] * workers()[1] + c[1]) * workers()[2] + ... for the
+ * coordinates c of the worker.
+ */
+template <size_t D>
+class CartesianGrid
+{
+public:
+    using Index = std::array<size_t, D>;
+
+    CartesianGrid(const Index& extents, size_t num_workers)
+        : extents_(extents), workers_(Factorize(extents, num_workers)) { }
+
+    //! number of points per dimension
+    const Index& extents() const { return extents_; }
+    //! number of workers per dimension
+    const Index& workers() const { return workers_; }
+
+    //! coordinates of the worker rank in the worker grid
+    Index Coordinates(size_t rank) const {
+        Index c;
+        for (size_t d = D; d-- > 0; ) {
+            c[d] = rank % workers_[d];
+            rank /= workers_[d];
+        }
+        return c;
+    }
+
+    //! rank of the worker at coordinates c
+    size_t Rank(const Index& c) const {
+        size_t rank = 0;
+        for (size_t d = 0; d < D; ++d) {
+            assert(c[d] < workers_[d]);
+            rank = rank * workers_[d] + c[d];
+        }
+        return rank;
+    }
+
+    //! range of points in dimension dim of the workers with coordinate c there
+    Range LocalRange(size_t dim, size_t c) const {
+        return CalculateLocalRange(extents_[dim], workers_[dim], c);
+    }
+
+    //! number of points per dimension of the tile of worker rank
+    Index LocalExtents(size_t rank) const {
+        Index c = Coordinates(rank), e;
+        for (size_t d = 0; d < D; ++d) e[d] = LocalRange(d, c[d]).size();
+        return e;
+    }
+
+    /*!
+     * Chooses the number of workers per dimension: among all factorizations
+     * of num_workers into D factors, the one which cuts the grid along the
+     * fewest points, sum_d (workers[d] - 1) * prod_{e != d} extents[e].
+     */
+    static Index Factorize(const Index& extents, size_t num_workers) {
+        assert(num_workers > 0);
+        Index current, best;
+        best.fill(1);
+        best[0] = num_workers;
+        Cost best_cost;
+        Search(extents, num_workers, 0, current, best, best_cost);
+        return best;
+    }
+
+private:
+    Index extents_;
+    Index workers_;
+
+    //! cost of a factorization: first whether workers remain without points,
+    //! then the cut surface
+    struct Cost {
+        bool empty = true;
+        double surface = std::numeric_limits<double>::infinity();
+
+        bool operator < (const Cost& b) const {
+            if (empty != b.empty) return !empty;
+            return surface < b.surface;
+        }
+    };
+
+    static Cost Evaluate(const Index& extents, const Index& workers) {
+        Cost cost;
+        cost.empty = false;
+        cost.surface = 0;
+        for (size_t d = 0; d < D; ++d) {
+            cost.empty = cost.empty || workers[d] > extents[d];
+            double face = 1;
+            for (size_t e = 0; e < D; ++e) {
+                if (e != d) face *= static_cast<double>(extents[e]);
+            }
+            cost.surface += static_cast<double>(workers[d] - 1) * face;
+        }
+        return cost;
+    }
+
+    //! enumerates the factors of the dimensions dim.. whose product is rest
+    static void Search(const Index& extents, size_t rest, size_t dim,
+                       Index& current, Index& best, Cost& best_cost) {
+        if (dim == D - 1) {
+            current[dim] = rest;
+            Cost cost = Evaluate(extents, current);
+            if (cost < best_cost) best = current, best_cost = cost;
+            return;
+        }
+        for (size_t f = 1; f <= rest; ++f) {
+            if (rest % f != 0) continue;
+            current[dim] = f;
+            Search(extents, rest / f, dim + 1, current, best, best_cost);
+        }
+    }
+};
+
+} // namespace common
+} // namespace thrill
+
+#endif // !THRILL_COMMON_CARTESIAN_GRID_HEADER
+
+/******************************************************************************/
@@ -74,6 +74,10 @@ static constexpr bool g_debug_push_file = false;
 #define THRILL_HAVE_AVX2
 #endif
 
+#if defined(__AVX512F__)
+#define THRILL_HAVE_AVX512F
+#endif
+
 } // namespace common
 } // namespace thrill
 
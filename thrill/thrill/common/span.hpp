@@ -0,0 +1,76 @@
+/*******************************************************************************
+ * thrill/common/span.hpp
+ *
+ * A non-owning view of a contiguous array, in the spirit of std::span.
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_COMMON_SPAN_HEADER
+#define THRILL_COMMON_SPAN_HEADER
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace thrill {
+namespace common {
+
+/*!
+ * Span refers to size items of type Type starting at data, which it does not
+ * own. Span<const Type> is a read-only view, a Span<Type> converts to it.
+ */
+template <typename Type>
+class Span
+{
+public:
+    using value_type = typename std::remove_cv<Type>::type;
+    using iterator = Type *;
+
+    Span() = default;
+
+    Span(Type* data, size_t size) : data_(data), size_(size) { }
+
+    //! view of all items of a vector
+    template <typename Vector>
+    explicit Span(Vector& vec) : data_(vec.data()), size_(vec.size()) { }
+
+    //! read-only view of a writable span
+    template <typename Other, typename = typename std::enable_if<
+                  std::is_same<const Other, Type>::value>::type>
+    Span(const Span<Other>& other) // NOLINT
+        : data_(other.data()), size_(other.size()) { }
+
+    Type * data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator begin() const { return data_; }
+    iterator end() const { return data_ + size_; }
+
+    Type& operator [] (size_t i) const {
+        assert(i < size_);
+        return data_[i];
+    }
+
+    //! view of count items starting at offset
+    Span subspan(size_t offset, size_t count) const {
+        assert(offset + count <= size_);
+        return Span(data_ + offset, count);
+    }
+
+private:
+    Type* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace common
+} // namespace thrill
+
+#endif // !THRILL_COMMON_SPAN_HEADER
+
+/******************************************************************************/
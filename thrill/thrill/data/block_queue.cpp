@@ -89,15 +89,15 @@ BlockQueue::Reader BlockQueue::GetReader(bool consume, size_t local_worker_id) {
 // ConsumeBlockQueueSource
 
 ConsumeBlockQueueSource::ConsumeBlockQueueSource(
-    BlockQueue& queue, size_t local_worker_id)
-    : queue_(queue), local_worker_id_(local_worker_id) { }
+    BlockQueue& queue, size_t local_worker_id, bool wait)
+    : queue_(queue), local_worker_id_(local_worker_id), wait_(wait) { }
 
 void ConsumeBlockQueueSource::Prefetch(size_t /* prefetch */) {
     // not supported yet. TODO(tb)
 }
 
 PinnedBlock ConsumeBlockQueueSource::NextBlock() {
-    Block b = queue_.Pop();
+    Block b = wait_ ? queue_.PopWait() : queue_.Pop();
     LOG << "ConsumeBlockQueueSource::NextBlock() " << b;
 
     if (!b.IsValid()) return PinnedBlock();
@@ -101,6 +101,17 @@ public:
         return b;
     }
 
+    //! Like Pop(), but waits for the next Block if the queue is empty instead
+    //! of taking it as closed. Returns an invalid Block once the writer has
+    //! closed the queue.
+    Block PopWait() {
+        if (read_closed_) return Block();
+        Block b;
+        queue_.pop(b);
+        read_closed_ = !b.IsValid();
+        return b;
+    }
+
     //! change dia_id after construction (needed because it may be unknown at
     //! construction)
     void set_dia_id(size_t dia_id) {
@@ -239,8 +250,9 @@ class ConsumeBlockQueueSource
     static constexpr bool debug = BlockQueue::debug;
 
 public:
-    //! Start reading from a BlockQueue
-    explicit ConsumeBlockQueueSource(BlockQueue& queue, size_t local_worker_id);
+    //! Start reading from a BlockQueue, if wait then with PopWait()
+    explicit ConsumeBlockQueueSource(BlockQueue& queue, size_t local_worker_id,
+                                     bool wait = false);
 
     void Prefetch(size_t /* prefetch */);
 
@@ -254,6 +266,9 @@ private:
 
     //! local worker id of the thread _reading_ the BlockQueue
     size_t local_worker_id_;
+
+    //! whether to wait for the writer to close the BlockQueue
+    bool wait_;
 };
 
 /*!
@@ -165,6 +165,14 @@ std::vector<CatStreamData::Reader> CatStreamData::GetReaders() {
     return result;
 }
 
+CatStreamData::Reader CatStreamData::GetReaderFrom(size_t from) {
+    assert(from < queues_.size());
+    rx_timespan_.StartEventually();
+
+    return BlockQueueReader(
+        BlockQueueSource(queues_[from], local_worker_id_, /* wait */ true));
+}
+
 CatStreamData::CatBlockSource CatStreamData::GetCatBlockSource(bool consume) {
     rx_timespan_.StartEventually();
 
@@ -355,6 +363,10 @@ std::vector<CatStream::Reader> CatStream::GetReaders() {
     return ptr_->GetReaders();
 }
 
+CatStream::Reader CatStream::GetReaderFrom(size_t from) {
+    return ptr_->GetReaderFrom(from);
+}
+
 CatStream::CatReader CatStream::GetCatReader(bool consume) {
     return ptr_->GetCatReader(consume);
 }
@@ -98,6 +98,11 @@ public:
     //! the Stream's remote close. These Readers _always_ consume!
     std::vector<Reader> GetReaders();
 
+    //! Creates a BlockReader for the items from worker from alone, which waits
+    //! for them until that worker closes its writer, so no other worker needs
+    //! to be done. This Reader _always_ consumes!
+    Reader GetReaderFrom(size_t from);
+
     //! Gets a CatBlockSource which includes all incoming queues of this stream.
     CatBlockSource GetCatBlockSource(bool consume);
 
@@ -183,6 +188,10 @@ public:
     //! the Stream's remote close. These Readers _always_ consume!
     std::vector<Reader> GetReaders();
 
+    //! Creates a BlockReader for the items from worker from alone, which waits
+    //! for them until that worker closes its writer.
+    Reader GetReaderFrom(size_t from);
+
     //! Creates a BlockReader which concatenates items from all workers in
     //! worker rank order. The BlockReader is attached to one \ref
     //! CatBlockSource which includes all incoming queues of this stream.
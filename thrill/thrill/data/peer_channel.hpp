@@ -0,0 +1,113 @@
+/*******************************************************************************
+ * thrill/data/peer_channel.hpp
+ *
+ * Part of Project Thrill - http://project-thrill.org
+ *
+ * All rights reserved. Published under the BSD-2 license in the LICENSE file.
+ ******************************************************************************/
+
+#pragma once
+#ifndef THRILL_DATA_PEER_CHANNEL_HEADER
+#define THRILL_DATA_PEER_CHANNEL_HEADER
+
+#include <thrill/data/cat_stream.hpp>
+#include <thrill/data/serialization.hpp>
+#include <thrill/net/buffer_builder.hpp>
+#include <thrill/net/buffer_reader.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace thrill {
+namespace data {
+
+//! \addtogroup data_layer
+//! \{
+
+/*!
+ * PeerChannel sends messages between single pairs of workers over one
+ * CatStream, which stays open until the PeerChannel is destroyed. A message is
+ * a vector of items with a tag and is flushed at once, and a worker receiving
+ * from a peer waits only for that peer's next message with the tag. Messages
+ * with other tags, e.g. of another DIA node which exchanges later, are kept
+ * until they are asked for. Messages of one tag between two workers arrive in
+ * the order they were sent.
+ *
+ * Closing a CatStream waits for the close messages of all workers, hence a
+ * stream per exchange makes every exchange a global synchronization. Nothing of
+ * the PeerChannel is closed per message, so an exchange only waits for the
+ * workers it receives from. The destructor closes the stream and thus must be
+ * called on all workers, like GetNewCatStream().
+ */
+class PeerChannel
+{
+public:
+    explicit PeerChannel(const CatStreamPtr& stream)
+        : stream_(stream), writers_(stream_->GetWriters()),
+          stash_(writers_.size()) { }
+
+    //! non-copyable: the writers can only be opened once
+    PeerChannel(const PeerChannel&) = delete;
+    PeerChannel& operator = (const PeerChannel&) = delete;
+
+    ~PeerChannel() {
+        writers_.Close();
+        stream_->Close();
+    }
+
+    //! Sends items to worker to as one message with the tag.
+    template <typename ItemType>
+    void Send(size_t to, size_t tag, const std::vector<ItemType>& items) {
+        net::BufferBuilder bb;
+        Serialization<net::BufferBuilder, std::vector<ItemType> >::Serialize(
+            items, bb);
+        writers_[to].Put(std::make_pair(tag, bb.ToString()));
+        writers_[to].Flush();
+    }
+
+    //! Receives the next message with the tag from worker from, waits for it
+    //! if it has not arrived yet.
+    template <typename ItemType>
+    std::vector<ItemType> Receive(size_t from, size_t tag) {
+        std::string message;
+        std::deque<std::string>& stashed = stash_[from][tag];
+        if (!stashed.empty()) {
+            message = std::move(stashed.front());
+            stashed.pop_front();
+        }
+        else {
+            CatStream::Reader reader = stream_->GetReaderFrom(from);
+            while (true) {
+                std::pair<size_t, std::string> next =
+                    reader.Next<std::pair<size_t, std::string> >();
+                if (next.first == tag) {
+                    message = std::move(next.second);
+                    break;
+                }
+                stash_[from][next.first].emplace_back(std::move(next.second));
+            }
+        }
+
+        net::BufferReader br(message.data(), message.size());
+        return Serialization<net::BufferReader, std::vector<ItemType> >::
+               Deserialize(br);
+    }
+
+private:
+    CatStreamPtr stream_;
+    CatStream::Writers writers_;
+    //! messages received ahead of their turn, by source worker and tag
+    std::vector<std::map<size_t, std::deque<std::string> > > stash_;
+};
+
+//! \}
+
+} // namespace data
+} // namespace thrill
+
+#endif // !THRILL_DATA_PEER_CHANNEL_HEADER
+
+/******************************************************************************/